@@ -0,0 +1,202 @@
+#include "batch.h"
+#include "cpu.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+// Rank 1 squares, the side to move always castles there
+#define BB_B1 (1ULL << 57)
+#define BB_C1 (1ULL << 58)
+#define BB_D1 (1ULL << 59)
+#define BB_F1 (1ULL << 61)
+#define BB_G1 (1ULL << 62)
+
+static inline Bitboard flip_vertical(Bitboard b)
+{
+#ifdef _MSC_VER
+    return _byteswap_uint64(b);
+#else
+    return __builtin_bswap64(b);
+#endif
+}
+
+// A step in one direction on the board: the files it can't land on without wrapping around, and left or right shift
+// of the square index
+typedef struct Shift
+{
+    Bitboard mask;
+    uint32_t left;
+    uint32_t right;
+} Shift;
+
+#define NOT_FILE_A (~BB_FILE(0))
+#define NOT_FILE_AB (~(BB_FILE(0) | BB_FILE(1)))
+#define NOT_FILE_H (~BB_FILE(7))
+#define NOT_FILE_GH (~(BB_FILE(6) | BB_FILE(7)))
+
+// Rook directions then bishop directions, the opposite direction is d ^ 1 and the line (pin axis) is d >> 1
+enum
+{
+    DIR_N,
+    DIR_S,
+    DIR_E,
+    DIR_W,
+    DIR_NE,
+    DIR_SW,
+    DIR_NW,
+    DIR_SE,
+};
+
+static const Shift directions[8] = {
+    {~BB_EMPTY, 0, 8},  {~BB_EMPTY, 8, 0},  {NOT_FILE_A, 1, 0}, {NOT_FILE_H, 0, 1},
+    {NOT_FILE_A, 0, 7}, {NOT_FILE_H, 7, 0}, {NOT_FILE_H, 0, 9}, {NOT_FILE_A, 9, 0},
+};
+
+static const Shift knight_jumps[8] = {
+    {NOT_FILE_A, 0, 15},  {NOT_FILE_H, 0, 17},  {NOT_FILE_AB, 0, 6},  {NOT_FILE_GH, 0, 10},
+    {NOT_FILE_A, 17, 0},  {NOT_FILE_H, 15, 0},  {NOT_FILE_AB, 10, 0}, {NOT_FILE_GH, 6, 0},
+};
+
+// The kernels apply the same operations to every lane. With GCC and Clang a group of lanes is one vector: 4 lanes for
+// SSE (2 registers) and AVX2, 8 for AVX-512 whose 32 registers hold the whole kernel. Otherwise a lane is handled at a
+// time.
+#if defined(__GNUC__) || defined(__clang__)
+// Vectors never cross a call boundary (the kernel helpers are always inlined), their calling convention doesn't matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef uint64_t Lanes4 __attribute__((vector_size(4 * sizeof(uint64_t))));
+typedef uint64_t Lanes8 __attribute__((vector_size(8 * sizeof(uint64_t))));
+
+#define LANES Lanes4
+#define LANES_WIDTH 4
+#define KERNEL(name) name##_x4
+#include "batch_kernel.h"
+#undef LANES
+#undef LANES_WIDTH
+#undef KERNEL
+
+#define LANES Lanes8
+#define LANES_WIDTH 8
+#define KERNEL(name) name##_x8
+#include "batch_kernel.h"
+#undef LANES
+#undef LANES_WIDTH
+#undef KERNEL
+
+#define analyze_lanes_narrow analyze_lanes_x4
+#define ANALYZE_NARROW_WIDTH 4
+#else
+#define LANES uint64_t
+#define LANES_WIDTH 1
+#define KERNEL(name) name##_x1
+#include "batch_kernel.h"
+#undef LANES
+#undef LANES_WIDTH
+#undef KERNEL
+
+#define analyze_lanes_narrow analyze_lanes_x1
+#define ANALYZE_NARROW_WIDTH 1
+#endif
+
+// One copy per ISA level
+#define DEFINE_ANALYZE(name, target, kernel, width)                                                                    \
+    target static void name(const PositionBatch *batch, BatchResult *out_result)                                       \
+    {                                                                                                                  \
+        for (size_t first = 0; first < BATCH_LANES; first += (width))                                                  \
+        {                                                                                                              \
+            kernel(batch, first, out_result);                                                                          \
+        }                                                                                                              \
+    }
+
+DEFINE_ANALYZE(analyze_baseline, , analyze_lanes_narrow, ANALYZE_NARROW_WIDTH)
+#ifdef CPU_MULTI_ISA
+DEFINE_ANALYZE(analyze_avx2, CPU_TARGET_AVX2, analyze_lanes_x4, 4)
+DEFINE_ANALYZE(analyze_avx512, CPU_TARGET_AVX512, analyze_lanes_x8, 8)
+#endif
+
+static void analyze(const PositionBatch *batch, BatchResult *out_result)
+{
+    CPU_DISPATCH_ISA_VOID(analyze, (batch, out_result));
+}
+
+void batch_clear(PositionBatch *batch)
+{
+    assert(batch != NULL);
+
+    memset(batch, 0, sizeof(*batch));
+}
+
+void batch_push(PositionBatch *batch, const BoardState *bs)
+{
+    assert(batch != NULL);
+    assert(bs != NULL);
+    assert(batch->len < BATCH_LANES);
+
+    size_t lane = batch->len++;
+    Color color = (Color)bs->turn;
+    Color enemy = color == C_WHITE ? C_BLACK : C_WHITE;
+
+    // Mirrored for black, so black's king side is also g1
+    bool flip = color == C_BLACK;
+    for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+    {
+        batch->pieces_bb[pt - 1][lane] = flip ? flip_vertical(bs->pieces_bb[pt - 1]) : bs->pieces_bb[pt - 1];
+    }
+    batch->us[lane] = flip ? flip_vertical(bs->color_bb[color - 1]) : bs->color_bb[color - 1];
+    batch->them[lane] = flip ? flip_vertical(bs->color_bb[enemy - 1]) : bs->color_bb[enemy - 1];
+
+    Bitboard en_passant = bs->en_passant != SQUARE_NONE ? square_bb(bs->en_passant) : BB_EMPTY;
+    batch->en_passant[lane] = flip ? flip_vertical(en_passant) : en_passant;
+
+    uint8_t king_side = color == C_WHITE ? CASTLE_RIGHT_WHITE_KING_SIDE : CASTLE_RIGHT_BLACK_KING_SIDE;
+    uint8_t queen_side = color == C_WHITE ? CASTLE_RIGHT_WHITE_QUEEN_SIDE : CASTLE_RIGHT_BLACK_QUEEN_SIDE;
+    batch->castles[lane] = ((bs->castle_rights & king_side) ? BB_G1 : BB_EMPTY) |
+                           ((bs->castle_rights & queen_side) ? BB_C1 : BB_EMPTY);
+
+    batch->turn[lane] = (uint8_t)color;
+}
+
+void batch_analyze(const PositionBatch *batch, BatchResult *out_result)
+{
+    assert(batch != NULL);
+    assert(out_result != NULL);
+
+    analyze(batch, out_result);
+
+    // Back to the orientation of the positions
+    for (size_t i = 0; i < BATCH_LANES; i++)
+    {
+        if (batch->turn[i] == C_BLACK)
+        {
+            out_result->attacked[i] = flip_vertical(out_result->attacked[i]);
+            out_result->checkers[i] = flip_vertical(out_result->checkers[i]);
+            out_result->pinned[i] = flip_vertical(out_result->pinned[i]);
+        }
+    }
+}
+
+void batch_count_legal_moves(const BoardState *positions, size_t count, uint32_t *out_counts)
+{
+    assert(positions != NULL || count == 0);
+    assert(out_counts != NULL || count == 0);
+
+    PositionBatch batch;
+    BatchResult result;
+    for (size_t first = 0; first < count; first += BATCH_LANES)
+    {
+        batch_clear(&batch);
+        size_t len = count - first < BATCH_LANES ? count - first : BATCH_LANES;
+        for (size_t i = 0; i < len; i++)
+        {
+            batch_push(&batch, &positions[first + i]);
+        }
+
+        batch_analyze(&batch, &result);
+        memcpy(&out_counts[first], result.legal_moves, len * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "bitboard.h"
+#include "board.h"
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Positions analyzed together, one per lane
+#define BATCH_LANES 8
+
+// Structure of arrays, so a bitboard of every lane is loaded at once.
+// Lanes are mirrored vertically when black is to move, so the side to move always moves towards rank 8.
+typedef struct PositionBatch
+{
+    Bitboard pieces_bb[6][BATCH_LANES]; // [type - 1][lane]
+    Bitboard us[BATCH_LANES];           // side to move
+    Bitboard them[BATCH_LANES];
+    Bitboard en_passant[BATCH_LANES];   // empty if none
+    Bitboard castles[BATCH_LANES];      // king destinations (g1, c1) allowed by the castle rights
+    uint8_t turn[BATCH_LANES];          // Color
+    size_t len;
+} PositionBatch;
+
+// Same orientation as the positions (not mirrored)
+typedef struct BatchResult
+{
+    Bitboard attacked[BATCH_LANES]; // squares attacked by the opponent, sliders see through the king
+    Bitboard checkers[BATCH_LANES];
+    Bitboard pinned[BATCH_LANES];   // own pieces pinned to the king
+    uint32_t legal_moves[BATCH_LANES];
+} BatchResult;
+
+void batch_clear(PositionBatch *batch);
+
+// bs must have a king of each color (as parse_fen checks), the batch must not be full
+void batch_push(PositionBatch *batch, const BoardState *bs);
+
+// Analyzes every lane at once with the selected ISA kernels, lanes after len are empty boards
+void batch_analyze(const PositionBatch *batch, BatchResult *out_result);
+
+// Number of legal moves of each position, as generate_legal_moves would count them
+void batch_count_legal_moves(const BoardState *positions, size_t count, uint32_t *out_counts);
+
+#ifdef __cplusplus
+}
+#endif
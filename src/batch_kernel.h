@@ -0,0 +1,195 @@
+// Body of the batch kernels, included by batch.c once per vector width (no include guard).
+// LANES is the vector type, LANES_WIDTH its number of lanes and KERNEL(name) gives the names of this width.
+
+#define load KERNEL(load)
+#define store KERNEL(store)
+#define nonzero KERNEL(nonzero)
+#define popcount_bytes KERNEL(popcount_bytes)
+#define sum_bytes KERNEL(sum_bytes)
+#define step KERNEL(step)
+#define slide KERNEL(slide)
+#define analyze_lanes KERNEL(analyze_lanes)
+
+static FORCE_INLINE LANES load(const Bitboard *lanes)
+{
+    LANES v;
+    memcpy(&v, lanes, sizeof(v));
+    return v;
+}
+
+static FORCE_INLINE void store(Bitboard *lanes, LANES v)
+{
+    memcpy(lanes, &v, sizeof(v));
+}
+
+// All ones in the lanes where x is not empty
+static FORCE_INLINE LANES nonzero(LANES x)
+{
+    return 0 - ((x | (0 - x)) >> 63);
+}
+
+// Bit count of each byte. Byte counts are added up before sum_bytes, a byte can take the counts of 31 bitboards.
+static FORCE_INLINE LANES popcount_bytes(LANES x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    return (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+}
+
+static FORCE_INLINE LANES sum_bytes(LANES x)
+{
+    x = (x & 0x00FF00FF00FF00FFULL) + ((x >> 8) & 0x00FF00FF00FF00FFULL);
+    x = (x & 0x0000FFFF0000FFFFULL) + ((x >> 16) & 0x0000FFFF0000FFFFULL);
+    return (x & 0x00000000FFFFFFFFULL) + (x >> 32);
+}
+
+static FORCE_INLINE LANES step(Shift s, LANES b)
+{
+    return ((b << s.left) >> s.right) & s.mask;
+}
+
+// Kogge-Stone fill from every square of gen, stopping on the first occupied square (included)
+static FORCE_INLINE LANES slide(Shift s, LANES gen, LANES empty)
+{
+    LANES pro = empty & s.mask;
+    gen |= pro & ((gen << s.left) >> s.right);
+    pro &= (pro << s.left) >> s.right;
+    gen |= pro & ((gen << (2 * s.left)) >> (2 * s.right));
+    pro &= (pro << (2 * s.left)) >> (2 * s.right);
+    gen |= pro & ((gen << (4 * s.left)) >> (4 * s.right));
+    return step(s, gen);
+}
+
+// Same rules as the legal generator of board.c, on the lanes [first, first + LANES_WIDTH)
+static FORCE_INLINE void analyze_lanes(const PositionBatch *batch, size_t first, BatchResult *out_result)
+{
+    LANES us = load(&batch->us[first]);
+    LANES them = load(&batch->them[first]);
+    LANES pawns = load(&batch->pieces_bb[PT_PAWN - 1][first]);
+    LANES knights = load(&batch->pieces_bb[PT_KNIGHT - 1][first]);
+    LANES bishops = load(&batch->pieces_bb[PT_BISHOP - 1][first]);
+    LANES rooks = load(&batch->pieces_bb[PT_ROOK - 1][first]);
+    LANES queens = load(&batch->pieces_bb[PT_QUEEN - 1][first]);
+    LANES kings = load(&batch->pieces_bb[PT_KING - 1][first]);
+
+    LANES empty = ~(us | them);
+    LANES king = kings & us;
+    LANES our_sliders[2] = {(rooks | queens) & us, (bishops | queens) & us};    // [rook, bishop]
+    LANES their_sliders[2] = {(rooks | queens) & them, (bishops | queens) & them}; // [rook, bishop]
+
+    // Squares attacked by them, without the king so it can't step back along a checking ray
+    LANES attacked = step(directions[DIR_SW], pawns & them) | step(directions[DIR_SE], pawns & them);
+    LANES king_steps = {0};
+    for (int d = 0; d < 8; d++)
+    {
+        attacked |= step(directions[d], kings & them) | slide(directions[d], their_sliders[d >> 2], empty | king);
+        attacked |= step(knight_jumps[d], knights & them);
+        king_steps |= step(directions[d], king);
+    }
+
+    LANES checkers = (step(directions[DIR_NE], king) | step(directions[DIR_NW], king)) & pawns & them;
+    LANES blocks = {0};
+    LANES pinned_on_line[4] = {0};
+    for (int d = 0; d < 8; d++)
+    {
+        checkers |= step(knight_jumps[d], king) & knights & them;
+
+        LANES sliders = their_sliders[d >> 2];
+        LANES ray = slide(directions[d], king, empty);
+        checkers |= ray & sliders;
+        // A checking slider can be captured or blocked anywhere on its ray
+        blocks |= ray & nonzero(ray & sliders);
+
+        // Again through the own piece ending the ray, it is pinned if a slider is behind it
+        LANES xray = slide(directions[d], king, empty | (ray & us));
+        pinned_on_line[d >> 1] |= ray & us & nonzero(xray & sliders);
+    }
+    LANES pinned = pinned_on_line[0] | pinned_on_line[1] | pinned_on_line[2] | pinned_on_line[3];
+
+    LANES in_check = nonzero(checkers);
+    LANES double_check = nonzero(checkers & (checkers - 1));
+    LANES target = ~us & (~in_check | blocks | checkers);
+
+    LANES king_moves = sum_bytes(popcount_bytes(king_steps & ~us & ~attacked));
+
+    // Each square is reached by at most one piece per direction, so every move is counted once.
+    // Counted per byte (20 bitboards), then summed.
+    LANES move_bytes = {0};
+    for (int d = 0; d < 8; d++)
+    {
+        LANES sliders = our_sliders[d >> 2] & (~pinned | pinned_on_line[d >> 1]);
+        move_bytes += popcount_bytes(slide(directions[d], sliders, empty) & target);
+        // A pinned knight can never move
+        move_bytes += popcount_bytes(step(knight_jumps[d], knights & us & ~pinned) & target);
+    }
+
+    LANES our_pawns = pawns & us;
+    LANES push = step(directions[DIR_N], our_pawns & (~pinned | pinned_on_line[DIR_N >> 1])) & empty;
+    LANES double_push = step(directions[DIR_N], push & BB_RANK(5)) & empty & target;
+    push &= target;
+    LANES capture_east = step(directions[DIR_NE], our_pawns & (~pinned | pinned_on_line[DIR_NE >> 1])) & them & target;
+    LANES capture_west = step(directions[DIR_NW], our_pawns & (~pinned | pinned_on_line[DIR_NW >> 1])) & them & target;
+    move_bytes += popcount_bytes(push) + popcount_bytes(double_push) + popcount_bytes(capture_east) +
+                  popcount_bytes(capture_west);
+    // Promotions are 4 moves, all on the same byte (rank 8) which has at most 8 pushes and 14 captures
+    LANES promotions = popcount_bytes(push & BB_RANK_8) + popcount_bytes(capture_east & BB_RANK_8) +
+                       popcount_bytes(capture_west & BB_RANK_8);
+    LANES moves = sum_bytes(move_bytes) + 3 * sum_bytes(promotions);
+
+    // En passant removes two pieces from the king's lines, the king's attackers are found again on the resulting
+    // occupancy (skipped when no lane can capture en passant)
+    bool has_en_passant = false;
+    for (size_t i = first; i < first + LANES_WIDTH; i++)
+    {
+        has_en_passant |= batch->en_passant[i] != BB_EMPTY;
+    }
+    if (has_en_passant)
+    {
+        LANES en_passant = load(&batch->en_passant[first]);
+        LANES captured = step(directions[DIR_S], en_passant);
+        static const int capture_dirs[2] = {DIR_NE, DIR_NW};
+        for (int c = 0; c < 2; c++)
+        {
+            LANES from = step(directions[capture_dirs[c] ^ 1], en_passant) & our_pawns;
+            LANES occupied = ((us | them) ^ from ^ captured) | en_passant;
+
+            LANES attackers = checkers & (knights | pawns) & ~captured;
+            for (int d = 0; d < 8; d++)
+            {
+                attackers |= slide(directions[d], king, ~occupied) & their_sliders[d >> 2];
+            }
+
+            moves += 1 & nonzero(from) & ~nonzero(attackers);
+        }
+    }
+
+    // The king can't castle out of, through or into check
+    LANES castles = load(&batch->castles[first]);
+    LANES kingside = castles & BB_G1 & ~nonzero(~empty & (BB_F1 | BB_G1)) & ~nonzero(attacked & (BB_F1 | BB_G1));
+    LANES queenside = castles & BB_C1 & ~nonzero(~empty & (BB_B1 | BB_C1 | BB_D1)) &
+                      ~nonzero(attacked & (BB_C1 | BB_D1));
+    LANES castle_moves = sum_bytes(popcount_bytes(kingside | queenside)) & ~in_check;
+
+    // In double check only the king can move
+    LANES legal_moves = king_moves + (moves & ~double_check) + castle_moves;
+
+    Bitboard counts[LANES_WIDTH];
+    store(counts, legal_moves);
+    store(&out_result->attacked[first], attacked);
+    store(&out_result->checkers[first], checkers);
+    store(&out_result->pinned[first], pinned);
+
+    for (size_t i = 0; i < LANES_WIDTH; i++)
+    {
+        out_result->legal_moves[first + i] = (uint32_t)counts[i];
+    }
+}
+
+#undef load
+#undef store
+#undef nonzero
+#undef popcount_bytes
+#undef sum_bytes
+#undef step
+#undef slide
+#undef analyze_lanes
@@ -0,0 +1,260 @@
+#include "bitboard.h"
+#include "cpu.h"
+#include "piece.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum Direction
+{
+    // Towards higher squares
+    DIR_EAST,
+    DIR_SOUTH,
+    DIR_SOUTH_EAST,
+    DIR_SOUTH_WEST,
+    // Towards lower squares
+    DIR_WEST,
+    DIR_NORTH,
+    DIR_NORTH_WEST,
+    DIR_NORTH_EAST,
+    DIR_COUNT
+} Direction;
+
+static const int8_t direction_x[DIR_COUNT] = {1, 0, 1, -1, -1, 0, -1, 1};
+static const int8_t direction_y[DIR_COUNT] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+AttackTables attack_tables = {0};
+static Bitboard ray_table[DIR_COUNT][64]; // [direction][square], squares after square towards the board edge
+
+// Found with a fixed-seed random search for this square layout
+static const Bitboard bishop_magics[64] = {
+    0x10102002004A1420ULL, 0x8020040400584008ULL, 0x10510800811201C8ULL, 0x5204042080000088ULL,
+    0x2204106880000002ULL, 0x1401042004000000ULL, 0x0400880410042004ULL, 0x0028208200A02020ULL,
+    0x1500241990010E00ULL, 0x8001200182020A40ULL, 0x40004101030B0000ULL, 0x8002041042000100ULL,
+    0x4010011041020038ULL, 0x0000010421044000ULL, 0x1500210808020A00ULL, 0x8000088400880520ULL,
+    0x0405004010040100ULL, 0x1005823210040108ULL, 0x2708008102040011ULL, 0x4048200404009100ULL,
+    0x0018104101400024ULL, 0x0003000601190101ULL, 0x8004803108491000ULL, 0x8014241200820800ULL,
+    0x0006E080100C3040ULL, 0x0501044A11041800ULL, 0x9020300008004045ULL, 0x0894080000220040ULL,
+    0x1001010083104000ULL, 0x5004030040900080ULL, 0x000400422C012400ULL, 0x0002128698404812ULL,
+    0x1010108404900440ULL, 0x0928021182084100ULL, 0x2006080409020024ULL, 0x1010202020180080ULL,
+    0xA010008200202200ULL, 0x2098015100019004ULL, 0x0002041440810811ULL, 0x802A02020000B098ULL,
+    0x0009015090004060ULL, 0x4000821082081001ULL, 0x0100210040420800ULL, 0x0800004010488A00ULL,
+    0x2000081104004040ULL, 0x4C8E029015000082ULL, 0x0420340322224842ULL, 0x1298260043400210ULL,
+    0x0000822802400008ULL, 0x00008A0101600000ULL, 0x3040003412080021ULL, 0x3040290220884800ULL,
+    0x4A1500401041004AULL, 0x8010200282020781ULL, 0x0020203142209091ULL, 0x0070300600902110ULL,
+    0x0040808800B62048ULL, 0x0000810400C44420ULL, 0x00080400440C0441ULL, 0x8340080020840411ULL,
+    0x0000000104208200ULL, 0x0000800810D00080ULL, 0x0400530411080200ULL, 0x4040702400932244ULL,
+};
+static const Bitboard rook_magics[64] = {
+    0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+    0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+    0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+    0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021D00100ULL,
+    0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+    0x0442000A00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040A00128541ULL,
+    0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+    0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000A0020ULL,
+    0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL, 0x0801100280080480ULL,
+    0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+    0x0000209300488001ULL, 0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL,
+};
+
+Magic bishop_magic_table[64];
+Magic rook_magic_table[64];
+
+Bitboard bishop_attack_table[BISHOP_ATTACK_TABLE_LEN];
+Bitboard rook_attack_table[ROOK_ATTACK_TABLE_LEN];
+
+SliderAttacks slider_attacks = SLIDER_ATTACKS_MAGIC;
+
+static Bitboard step_bb(Square sq, int8_t dx, int8_t dy)
+{
+    Pos pos = square_to_pos(sq);
+    Pos target = {pos.x + dx, pos.y + dy};
+
+    if (target.x < 0 || target.x > 7 || target.y < 0 || target.y > 7)
+    {
+        return BB_EMPTY;
+    }
+
+    return square_bb(pos_to_square(target));
+}
+
+// Attacks along one ray, stopping at (and including) the first blocker
+static Bitboard ray_attacks(Square sq, Bitboard occupied, Direction dir)
+{
+    Bitboard attacks = ray_table[dir][sq];
+    Bitboard blockers = attacks & occupied;
+
+    if (blockers != BB_EMPTY)
+    {
+        Square blocker = dir < DIR_WEST ? lsb(blockers) : msb(blockers);
+        attacks ^= ray_table[dir][blocker];
+    }
+
+    return attacks;
+}
+
+static Bitboard bishop_attacks_rays(Square sq, Bitboard occupied)
+{
+    return ray_attacks(sq, occupied, DIR_SOUTH_EAST) | ray_attacks(sq, occupied, DIR_SOUTH_WEST) |
+           ray_attacks(sq, occupied, DIR_NORTH_WEST) | ray_attacks(sq, occupied, DIR_NORTH_EAST);
+}
+
+static Bitboard rook_attacks_rays(Square sq, Bitboard occupied)
+{
+    return ray_attacks(sq, occupied, DIR_EAST) | ray_attacks(sq, occupied, DIR_SOUTH) |
+           ray_attacks(sq, occupied, DIR_WEST) | ray_attacks(sq, occupied, DIR_NORTH);
+}
+
+// Ray without its last square, the occupancy of the board edge never changes the attacks
+static Bitboard ray_mask(Square sq, Direction dir)
+{
+    Bitboard ray = ray_table[dir][sq];
+    if (ray == BB_EMPTY)
+    {
+        return BB_EMPTY;
+    }
+
+    return ray & ~square_bb(dir < DIR_WEST ? msb(ray) : lsb(ray));
+}
+
+static void init_magics(Magic magic_table[64], Bitboard *attack_table, size_t attack_table_len, const Bitboard magics[64],
+                        bool bishop, SliderAttacks method)
+{
+    uint32_t offset = 0;
+
+    for (Square sq = 0; sq < 64; sq++)
+    {
+        Magic *m = &magic_table[sq];
+        if (bishop)
+        {
+            m->mask = ray_mask(sq, DIR_SOUTH_EAST) | ray_mask(sq, DIR_SOUTH_WEST) | ray_mask(sq, DIR_NORTH_WEST) |
+                      ray_mask(sq, DIR_NORTH_EAST);
+        }
+        else
+        {
+            m->mask = ray_mask(sq, DIR_EAST) | ray_mask(sq, DIR_SOUTH) | ray_mask(sq, DIR_WEST) |
+                      ray_mask(sq, DIR_NORTH);
+        }
+        m->magic = magics[sq];
+        m->offset = offset;
+        m->shift = 64 - popcount(m->mask);
+
+#ifndef NDEBUG
+        // A magic may map two occupancies to one index, only if they have the same attacks
+        static bool filled[1U << 12];
+        memset(filled, 0, sizeof(filled));
+#endif
+
+        // Enumerate every subset of the mask (Carry-Rippler)
+        Bitboard occupied = BB_EMPTY;
+        do
+        {
+            size_t local_index = slider_index(occupied, m, method);
+            size_t index = m->offset + local_index;
+            Bitboard attacks = bishop ? bishop_attacks_rays(sq, occupied) : rook_attacks_rays(sq, occupied);
+#ifndef NDEBUG
+            assert(local_index < (1U << popcount(m->mask)));
+            assert(!filled[local_index] || attack_table[index] == attacks);
+            filled[local_index] = true;
+#endif
+            attack_table[index] = attacks;
+
+            occupied = (occupied - m->mask) & m->mask;
+        } while (occupied != BB_EMPTY);
+
+        offset += 1U << popcount(m->mask);
+    }
+
+    assert(offset == attack_table_len);
+    (void)attack_table_len;
+}
+
+void bitboard_init(void)
+{
+    for (Square sq = 0; sq < 64; sq++)
+    {
+        attack_tables.pawn[C_WHITE - 1][sq] = step_bb(sq, -1, -1) | step_bb(sq, 1, -1);
+        attack_tables.pawn[C_BLACK - 1][sq] = step_bb(sq, -1, 1) | step_bb(sq, 1, 1);
+
+        attack_tables.knight[sq] = step_bb(sq, -2, -1) | step_bb(sq, -2, 1) | step_bb(sq, 2, -1) |
+                                   step_bb(sq, 2, 1) | step_bb(sq, 1, -2) | step_bb(sq, -1, -2) |
+                                   step_bb(sq, 1, 2) | step_bb(sq, -1, 2);
+
+        attack_tables.king[sq] = step_bb(sq, -1, -1) | step_bb(sq, 0, -1) | step_bb(sq, 1, -1) |
+                                 step_bb(sq, -1, 0) | step_bb(sq, 1, 0) | step_bb(sq, -1, 1) |
+                                 step_bb(sq, 0, 1) | step_bb(sq, 1, 1);
+
+        for (Direction dir = 0; dir < DIR_COUNT; dir++)
+        {
+            Bitboard ray = BB_EMPTY;
+            Square current = sq;
+            Bitboard next;
+            while ((next = step_bb(current, direction_x[dir], direction_y[dir])) != BB_EMPTY)
+            {
+                ray |= next;
+                current = lsb(next);
+            }
+            ray_table[dir][sq] = ray;
+        }
+    }
+
+    for (Square from = 0; from < 64; from++)
+    {
+        for (Direction dir = 0; dir < DIR_COUNT; dir++)
+        {
+            Bitboard ray = ray_table[dir][from];
+            Bitboard line = ray | ray_table[(dir + 4) % DIR_COUNT][from] | square_bb(from); // opposite ray
+
+            Bitboard targets = ray;
+            while (targets != BB_EMPTY)
+            {
+                Square to = pop_lsb(&targets);
+                attack_tables.between[from][to] = ray & ~ray_table[dir][to] & ~square_bb(to);
+                attack_tables.line[from][to] = line;
+            }
+        }
+    }
+
+    bitboard_use_slider_attacks(cpu_features().fast_pext ? SLIDER_ATTACKS_PEXT : SLIDER_ATTACKS_MAGIC);
+    cpu_use_isa(cpu_best_isa());
+}
+
+bool bitboard_use_slider_attacks(SliderAttacks method)
+{
+    if (method == SLIDER_ATTACKS_PEXT && !cpu_features().bmi2)
+    {
+        return false;
+    }
+
+    init_magics(bishop_magic_table, bishop_attack_table, BISHOP_ATTACK_TABLE_LEN, bishop_magics, true, method);
+    init_magics(rook_magic_table, rook_attack_table, ROOK_ATTACK_TABLE_LEN, rook_magics, false, method);
+    slider_attacks = method;
+
+    return true;
+}
+
+SliderAttacks bitboard_slider_attacks(void)
+{
+    return slider_attacks;
+}
+
+const char *slider_attacks_name(SliderAttacks method)
+{
+    switch (method)
+    {
+    case SLIDER_ATTACKS_MAGIC:
+        return "magic";
+    case SLIDER_ATTACKS_PEXT:
+        return "pext";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "common.h"
+#include "cpu.h"
+#include "move.h"
+#include "piece.h"
+
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One bit per square, bit index is the square
+typedef uint64_t Bitboard;
+
+#define SQUARE_NONE ((Square)-1)
+
+#define BB_EMPTY 0ULL
+#define BB_FILE_A 0x0101010101010101ULL
+#define BB_FILE_H 0x8080808080808080ULL
+#define BB_RANK_8 0x00000000000000FFULL // y = 0
+#define BB_RANK_1 0xFF00000000000000ULL // y = 7
+
+#define BB_RANK(y) (BB_RANK_8 << (8 * (y)))
+#define BB_FILE(x) (BB_FILE_A << (x))
+
+static inline Square pos_to_square(Pos pos)
+{
+    return (Square)(pos.x + pos.y * 8);
+}
+static inline Pos square_to_pos(Square sq)
+{
+    return (Pos){(int8_t)(sq & 7), (int8_t)(sq >> 3)};
+}
+static inline Bitboard square_bb(Square sq)
+{
+    return 1ULL << sq;
+}
+
+static inline int popcount(Bitboard b)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(b);
+#else
+    return __builtin_popcountll(b);
+#endif
+}
+
+// b must not be empty
+static inline Square lsb(Bitboard b)
+{
+    assert(b != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, b);
+    return (Square)index;
+#else
+    return (Square)__builtin_ctzll(b);
+#endif
+}
+
+// b must not be empty
+static inline Square msb(Bitboard b)
+{
+    assert(b != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, b);
+    return (Square)index;
+#else
+    return (Square)(63 ^ __builtin_clzll(b));
+#endif
+}
+
+// Removes and returns the least significant square, b must not be empty
+static inline Square pop_lsb(Bitboard *b)
+{
+    Square sq = lsb(*b);
+    *b &= *b - 1;
+    return sq;
+}
+
+typedef enum SliderAttacks
+{
+    SLIDER_ATTACKS_MAGIC,
+    SLIDER_ATTACKS_PEXT, // needs BMI2
+} SliderAttacks;
+
+// Must be called once before any attack lookup, picks the fastest slider attacks and kernels for this CPU
+void bitboard_init(void);
+
+// Rebuilds the slider tables for method, false if the CPU can't run it. Not safe while other threads use the tables
+bool bitboard_use_slider_attacks(SliderAttacks method);
+SliderAttacks bitboard_slider_attacks(void);
+const char *slider_attacks_name(SliderAttacks method);
+
+// The tables are filled by bitboard_init. They are visible so the lookups below inline into the kernels built per ISA
+// level, an out of line lookup would always run the baseline build.
+
+typedef struct AttackTables
+{
+    Bitboard pawn[2][64]; // [color][square], -1 is substracted from color
+    Bitboard knight[64];
+    Bitboard king[64];
+    Bitboard between[64][64]; // [from][to]
+    Bitboard line[64][64];    // [from][to]
+} AttackTables;
+
+extern AttackTables attack_tables;
+
+// Fancy magic bitboards, https://www.chessprogramming.org/Magic_Bitboards
+// The relevant occupancy of a slider is hashed with a magic multiplication into its attack table.
+// With fast BMI2 the same tables are instead indexed by PEXT of the occupancy (the magic is unused).
+typedef struct Magic
+{
+    Bitboard mask;   // relevant occupancy, edges excluded
+    Bitboard magic;
+    uint32_t offset; // of this square's attacks in the shared table
+    uint32_t shift;  // 64 - popcount(mask)
+} Magic;
+
+#define BISHOP_ATTACK_TABLE_LEN 5248
+#define ROOK_ATTACK_TABLE_LEN 102400
+
+extern Magic bishop_magic_table[64];
+extern Magic rook_magic_table[64];
+extern Bitboard bishop_attack_table[BISHOP_ATTACK_TABLE_LEN];
+extern Bitboard rook_attack_table[ROOK_ATTACK_TABLE_LEN];
+extern SliderAttacks slider_attacks; // method the tables are indexed with
+
+// PEXT is emitted whatever the build flags (inline assembly, so it inlines into the lookups),
+// and only executed when the CPU has fast BMI2
+#ifdef CPU_X86_64
+static inline uint64_t pext_u64(uint64_t src, uint64_t mask)
+{
+#ifdef _MSC_VER
+    return _pext_u64(src, mask);
+#else
+    uint64_t result;
+    __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(src), "rm"(mask));
+    return result;
+#endif
+}
+#endif
+
+static inline size_t slider_index(Bitboard occupied, const Magic *m, SliderAttacks method)
+{
+#ifdef CPU_X86_64
+    if (method == SLIDER_ATTACKS_PEXT)
+    {
+        return (size_t)pext_u64(occupied, m->mask);
+    }
+#endif
+    (void)method;
+
+    return (size_t)(((occupied & m->mask) * m->magic) >> m->shift);
+}
+
+static inline Bitboard pawn_attacks(Color c, Square sq)
+{
+    return attack_tables.pawn[c - 1][sq];
+}
+
+static inline Bitboard pawns_attacks(Color c, Bitboard pawns)
+{
+    if (c == C_WHITE)
+    {
+        return ((pawns >> 9) & ~BB_FILE_H) | ((pawns >> 7) & ~BB_FILE_A);
+    }
+    else
+    {
+        return ((pawns << 7) & ~BB_FILE_H) | ((pawns << 9) & ~BB_FILE_A);
+    }
+}
+
+static inline Bitboard knight_attacks(Square sq)
+{
+    return attack_tables.knight[sq];
+}
+
+static inline Bitboard king_attacks(Square sq)
+{
+    return attack_tables.king[sq];
+}
+
+static inline Bitboard bishop_attacks(Square sq, Bitboard occupied)
+{
+    const Magic *m = &bishop_magic_table[sq];
+    return bishop_attack_table[m->offset + slider_index(occupied, m, slider_attacks)];
+}
+
+static inline Bitboard rook_attacks(Square sq, Bitboard occupied)
+{
+    const Magic *m = &rook_magic_table[sq];
+    return rook_attack_table[m->offset + slider_index(occupied, m, slider_attacks)];
+}
+
+static inline Bitboard queen_attacks(Square sq, Bitboard occupied)
+{
+    return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
+
+// Squares strictly between from and to, empty if they are not on a common rank, file or diagonal
+static inline Bitboard between_bb(Square from, Square to)
+{
+    return attack_tables.between[from][to];
+}
+
+// Whole rank, file or diagonal going through from and to, empty if there is none
+static inline Bitboard line_bb(Square from, Square to)
+{
+    return attack_tables.line[from][to];
+}
+
+#ifdef __cplusplus
+}
+#endif
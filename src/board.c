@@ -1,5 +1,7 @@
 #include "board.h"
-#include "array.h"
+#include "bitboard.h"
+#include "cpu.h"
+#include "fen.h"
 #include "move.h"
 #include "piece.h"
 #include "zobrist.h"
@@ -13,265 +15,76 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int8_t pieces_all_color_len(PiecesListLengths *pll)
-{
-    return pll->pawn_len + pll->knight_len + pll->bishop_len + pll->rook_len + pll->queen_len + pll->king_len;
-}
-
-void pieces_offset(PiecesList *pl, PieceType pt, Color c, int8_t *out_index, int8_t **out_len)
-{
-    assert(pl != NULL);
-    assert(out_index != NULL);
-    assert(out_len != NULL);
-
-    int8_t index = c == C_WHITE ? 0 : pieces_all_color_len(&pl->white);
-    PiecesListLengths *pll = c == C_WHITE ? &pl->white : &pl->black;
-
-    if (pt == PT_PAWN)
-    {
-        *out_index = index;
-        *out_len = &pll->pawn_len;
-        return;
-    }
-    index += pll->pawn_len;
-
-    if (pt == PT_KNIGHT)
-    {
-        *out_index = index;
-        *out_len = &pll->knight_len;
-        return;
-    }
-    index += pll->knight_len;
-
-    if (pt == PT_BISHOP)
-    {
-        *out_index = index;
-        *out_len = &pll->bishop_len;
-        return;
-    }
-    index += pll->bishop_len;
-
-    if (pt == PT_ROOK)
-    {
-        *out_index = index;
-        *out_len = &pll->rook_len;
-        return;
-    }
-    index += pll->rook_len;
-
-    if (pt == PT_QUEEN)
-    {
-        *out_index = index;
-        *out_len = &pll->queen_len;
-        return;
-    }
-    index += pll->queen_len;
-
-    if (pt == PT_KING)
-    {
-        *out_index = index;
-        *out_len = &pll->king_len;
-        return;
-    }
+// Positions are copied by value, a third cache line would be touched on every copy
+_Static_assert(sizeof(BoardState) <= 128, "BoardState must fit in two cache lines");
 
-    assert(false && "Invalid piece type");
-}
-void pieces_all_color_offset(PiecesList *pl, Color c, int8_t *out_index, int8_t *out_len)
+BoardState load_fen(const char *fen)
 {
-    assert(pl != NULL);
-    assert(out_index != NULL);
-    assert(out_len != NULL);
-
-    if (c == C_WHITE)
-    {
-        *out_index = 0;
-        *out_len = pieces_all_color_len(&pl->white);
-    }
-    else
-    {
-        *out_index = pieces_all_color_len(&pl->white);
-        *out_len = pieces_all_color_len(&pl->black);
-    }
-}
+    assert(fen != NULL);
 
-static int8_t pieces_total_len(PiecesList *pl)
-{
-    assert(pl != NULL);
+    BoardState bs = {0};
+    FenError error = parse_fen(fen, &bs, NULL);
+    assert(error == FEN_OK && "Invalid fen");
+    (void)error;
 
-    return pieces_all_color_len(&pl->white) + pieces_all_color_len(&pl->black);
+    return bs;
 }
 
-static void pieces_insert(PiecesList *pl, Piece p, Pos pos)
-{
-    assert(pl != NULL);
-    assert(pieces_total_len(pl) < 64);
-
-    int8_t index;
-    int8_t *len;
-    pieces_offset(pl, get_type(p), get_color(p), &index, &len);
-
-    memmove(&pl->list[index + 1], &pl->list[index], (pieces_total_len(pl) - index + 1) * sizeof(Pos));
-
-    pl->list[index] = pos;
-    (*len)++;
-}
-static void pieces_remove(PiecesList *pl, Piece p, Pos pos)
+void board_refresh_keys(BoardState *bs)
 {
-    assert(pl != NULL);
-    assert(pieces_total_len(pl) > 0);
+    assert(bs != NULL);
 
-    int8_t index;
-    int8_t *len;
-    pieces_offset(pl, get_type(p), get_color(p), &index, &len);
+    bs->zobrist_hash = 0;
+    bs->pawn_key = 0;
+    bs->material_key = 0;
+    bs->non_pawn_key[0] = 0;
+    bs->non_pawn_key[1] = 0;
 
-    // Find the piece
-    for (int8_t i = index; i < index + *len; i++)
+    for (Color c = C_WHITE; c <= C_BLACK; c++)
     {
-        if (pl->list[i].x == pos.x && pl->list[i].y == pos.y)
+        for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
         {
-            memmove(&pl->list[i], &pl->list[i + 1], (pieces_total_len(pl) - i - 1) * sizeof(Pos));
-            (*len)--;
-            return;
-        }
-    }
-}
-
-BoardState load_fen(const char *fen)
-{
-    assert(fen != NULL);
+            Piece p = create_piece(pt, c);
+            Bitboard pieces = get_pieces_bitboard(bs, pt, c);
 
-    BoardState bs = {0};
-    bs.en_passant_x = NO_EN_PASSANT;
-    bs.en_passant_y = NO_EN_PASSANT;
+            // Same keys xor_piece toggles when adding the pieces one by one
+            for (int count = 0; count < popcount(pieces); count++)
+            {
+                bs->material_key ^= zobrist_material(p, count);
+            }
 
-    int8_t x = 0;
-    int8_t y = 0;
+            while (pieces != BB_EMPTY)
+            {
+                uint64_t key = zobrist_piece(p, square_to_pos(pop_lsb(&pieces)));
+                bs->zobrist_hash ^= key;
+                if (pt == PT_PAWN)
+                {
+                    bs->pawn_key ^= key;
+                }
+                else
+                {
+                    bs->non_pawn_key[c - 1] ^= key;
+                }
+            }
+        }
 
-    while (!(x == 8 && y == 7))
-    {
-        switch (*fen++)
+        for (int king_side = 0; king_side < 2; king_side++)
         {
-        case 'p':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_PAWN, C_BLACK));
-            x++;
-            break;
-        case 'n':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_KNIGHT, C_BLACK));
-            x++;
-            break;
-        case 'b':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_BISHOP, C_BLACK));
-            x++;
-            break;
-        case 'r':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_ROOK, C_BLACK));
-            x++;
-            break;
-        case 'q':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_QUEEN, C_BLACK));
-            x++;
-            break;
-        case 'k':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_KING, C_BLACK));
-            x++;
-            break;
-
-        case 'P':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_PAWN, C_WHITE));
-            x++;
-            break;
-        case 'N':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_KNIGHT, C_WHITE));
-            x++;
-            break;
-        case 'B':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_BISHOP, C_WHITE));
-            x++;
-            break;
-        case 'R':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_ROOK, C_WHITE));
-            x++;
-            break;
-        case 'Q':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_QUEEN, C_WHITE));
-            x++;
-            break;
-        case 'K':
-            set_piece(&bs, (Pos){x, y}, create_piece(PT_KING, C_WHITE));
-            x++;
-            break;
-
-        case '1':
-            x += 1;
-            break;
-        case '2':
-            x += 2;
-            break;
-        case '3':
-            x += 3;
-            break;
-        case '4':
-            x += 4;
-            break;
-        case '5':
-            x += 5;
-            break;
-        case '6':
-            x += 6;
-            break;
-        case '7':
-            x += 7;
-            break;
-        case '8':
-            x += 8;
-            break;
-
-        case '/':
-            x = 0;
-            y++;
-            break;
+            if (has_castle_right(bs, c, king_side))
+            {
+                bs->zobrist_hash ^= zobrist_castle_right(c, king_side);
+            }
         }
     }
 
-    fen++; // space
-    bs.turn = *fen++ == 'w' ? C_WHITE : C_BLACK;
-    if (bs.turn == C_BLACK)
-    {
-        bs.zobrist_hash ^= zobrist_black();
-    }
-    fen++; // space
-
-    while (*fen != ' ')
+    if (bs->en_passant != SQUARE_NONE)
     {
-        switch (*fen++)
-        {
-        case 'K':
-            update_castle_right(&bs, C_WHITE, true, true);
-            break;
-        case 'Q':
-            update_castle_right(&bs, C_WHITE, false, true);
-            break;
-        case 'k':
-            update_castle_right(&bs, C_BLACK, true, true);
-            break;
-        case 'q':
-            update_castle_right(&bs, C_BLACK, false, true);
-            break;
-        }
+        bs->zobrist_hash ^= zobrist_en_passant(square_to_pos(bs->en_passant).x);
     }
-    fen++; // space
-
-    if (*fen != '-')
+    if (bs->turn == C_BLACK)
     {
-        bs.en_passant_x = *fen++ - 'a';       // file
-        bs.en_passant_y = 7 - (*fen++ - '1'); // rank
-        bs.zobrist_hash ^= zobrist_en_passant(bs.en_passant_y);
+        bs->zobrist_hash ^= zobrist_black();
     }
-    fen++; // space
-
-    sscanf(fen, "%d %d", &bs.halfmove_clock, &bs.fullmove_number);
-
-    return bs;
 }
 
 void print_board(BoardState *bs)
@@ -286,7 +99,7 @@ void print_board(BoardState *bs)
         {
             fputs("| ", stdout);
 
-            Piece p = bs->board[x][y];
+            Piece p = get_piece(bs, (Pos){x, y});
             if (is_empty(p))
             {
                 fputs(" ", stdout);
@@ -370,24 +183,56 @@ void print_attack_map(bool attack_map[8][8])
     }
 }
 
+// Adds or removes p on sq, without touching the hash
+static FORCE_INLINE void toggle_piece(BoardState *bs, Square sq, Piece p)
+{
+    Bitboard bb = square_bb(sq);
+    bs->pieces_bb[get_type(p) - 1] ^= bb;
+    bs->color_bb[get_color(p) - 1] ^= bb;
+}
+
+// Adds or removes p on sq, with every key
+static FORCE_INLINE void xor_piece(BoardState *bs, Square sq, Piece p)
+{
+    PieceType pt = get_type(p);
+    Color c = get_color(p);
+    Bitboard same = bs->pieces_bb[pt - 1] & bs->color_bb[c - 1];
+
+    // The n-th piece of a kind always toggles the same material key, added or removed
+    int count = popcount(same) - ((same & square_bb(sq)) != BB_EMPTY);
+    bs->material_key ^= zobrist_material(p, count);
+
+    uint64_t key = zobrist_piece(p, square_to_pos(sq));
+    bs->zobrist_hash ^= key;
+    if (pt == PT_PAWN)
+    {
+        bs->pawn_key ^= key;
+    }
+    else
+    {
+        bs->non_pawn_key[c - 1] ^= key;
+    }
+
+    toggle_piece(bs, sq, p);
+}
+
 void set_piece(BoardState *bs, Pos pos, Piece p)
 {
     assert(bs != NULL);
     assert(pos.x >= 0 && pos.x <= 7);
     assert(pos.y >= 0 && pos.y <= 7);
 
-    if (!is_empty(bs->board[pos.x][pos.y]))
+    Square sq = pos_to_square(pos);
+    Piece old = piece_on(bs, sq);
+
+    if (!is_empty(old))
     {
-        pieces_remove(&bs->pieces, bs->board[pos.x][pos.y], pos);
-        bs->zobrist_hash ^= zobrist_piece(bs->board[pos.x][pos.y], pos);
+        xor_piece(bs, sq, old);
     }
 
-    bs->board[pos.x][pos.y] = p;
-
     if (!is_empty(p))
     {
-        pieces_insert(&bs->pieces, p, pos);
-        bs->zobrist_hash ^= zobrist_piece(bs->board[pos.x][pos.y], pos);
+        xor_piece(bs, sq, p);
     }
 }
 
@@ -397,128 +242,209 @@ Piece get_piece(BoardState *bs, Pos pos)
     assert(pos.x >= 0 && pos.x <= 7);
     assert(pos.y >= 0 && pos.y <= 7);
 
-    return bs->board[pos.x][pos.y];
+    return piece_on(bs, pos_to_square(pos));
 }
 
-void update_castle_right(BoardState *bs, Color c, bool king_side, bool value)
+Piece piece_on(BoardState *bs, Square sq)
 {
     assert(bs != NULL);
+    assert(sq >= 0 && sq < 64);
 
-    bool *castle_right;
+    Bitboard bb = square_bb(sq);
+    if ((get_occupied_bitboard(bs) & bb) == BB_EMPTY)
+    {
+        return piece_empty();
+    }
 
-    if (c == C_WHITE)
+    Color c = (bs->color_bb[C_WHITE - 1] & bb) != BB_EMPTY ? C_WHITE : C_BLACK;
+    for (PieceType pt = PT_PAWN; pt < PT_KING; pt++)
     {
-        if (king_side)
+        if ((bs->pieces_bb[pt - 1] & bb) != BB_EMPTY)
         {
-            castle_right = &bs->white_king_side_castle;
-        }
-        else
-        {
-            castle_right = &bs->white_queen_side_castle;
+            return create_piece(pt, c);
         }
     }
-    else
+
+    return create_piece(PT_KING, c);
+}
+
+Bitboard get_pieces_bitboard(BoardState *bs, PieceType pt, Color c)
+{
+    assert(bs != NULL);
+
+    return bs->pieces_bb[pt - 1] & bs->color_bb[c - 1];
+}
+
+Bitboard get_color_bitboard(BoardState *bs, Color c)
+{
+    assert(bs != NULL);
+
+    return bs->color_bb[c - 1];
+}
+
+Bitboard get_occupied_bitboard(BoardState *bs)
+{
+    assert(bs != NULL);
+
+    return bs->color_bb[0] | bs->color_bb[1];
+}
+
+static uint8_t castle_right_flag(Color c, bool king_side)
+{
+    if (c == C_WHITE)
     {
-        if (king_side)
-        {
-            castle_right = &bs->black_king_side_castle;
-        }
-        else
+        return king_side ? CASTLE_RIGHT_WHITE_KING_SIDE : CASTLE_RIGHT_WHITE_QUEEN_SIDE;
+    }
+    return king_side ? CASTLE_RIGHT_BLACK_KING_SIDE : CASTLE_RIGHT_BLACK_QUEEN_SIDE;
+}
+
+bool has_castle_right(BoardState *bs, Color c, bool king_side)
+{
+    assert(bs != NULL);
+
+    return (bs->castle_rights & castle_right_flag(c, king_side)) != 0;
+}
+
+// Replaces the castling rights, hashing in and out the rights that changed
+static void set_castle_rights(BoardState *bs, uint8_t castle_rights)
+{
+    uint8_t changed = bs->castle_rights ^ castle_rights;
+    if (changed == 0)
+    {
+        return;
+    }
+
+    for (Color c = C_WHITE; c <= C_BLACK; c++)
+    {
+        for (int king_side = 0; king_side < 2; king_side++)
         {
-            castle_right = &bs->black_queen_side_castle;
+            if (changed & castle_right_flag(c, king_side))
+            {
+                bs->zobrist_hash ^= zobrist_castle_right(c, king_side);
+            }
         }
     }
 
-    if (*castle_right != value)
+    bs->castle_rights = castle_rights;
+}
+
+void update_castle_right(BoardState *bs, Color c, bool king_side, bool value)
+{
+    assert(bs != NULL);
+
+    uint8_t flag = castle_right_flag(c, king_side);
+    set_castle_rights(bs, value ? bs->castle_rights | flag : bs->castle_rights & ~flag);
+}
+
+// Rights kept when a piece leaves or lands on sq, moving the king or a rook, or capturing a rook, loses them
+static uint8_t castle_rights_kept(Square sq)
+{
+    switch (sq)
     {
-        bs->zobrist_hash ^= zobrist_castle_right(c, king_side);
-        *castle_right = value;
+    case 0: // a8
+        return CASTLE_RIGHTS_ALL & ~CASTLE_RIGHT_BLACK_QUEEN_SIDE;
+    case 4: // e8
+        return CASTLE_RIGHTS_ALL & ~(CASTLE_RIGHT_BLACK_KING_SIDE | CASTLE_RIGHT_BLACK_QUEEN_SIDE);
+    case 7: // h8
+        return CASTLE_RIGHTS_ALL & ~CASTLE_RIGHT_BLACK_KING_SIDE;
+    case 56: // a1
+        return CASTLE_RIGHTS_ALL & ~CASTLE_RIGHT_WHITE_QUEEN_SIDE;
+    case 60: // e1
+        return CASTLE_RIGHTS_ALL & ~(CASTLE_RIGHT_WHITE_KING_SIDE | CASTLE_RIGHT_WHITE_QUEEN_SIDE);
+    case 63: // h1
+        return CASTLE_RIGHTS_ALL & ~CASTLE_RIGHT_WHITE_KING_SIDE;
+    default:
+        return CASTLE_RIGHTS_ALL;
     }
 }
 
 void make_move(BoardState *bs, Move move)
 {
-    assert(bs != NULL);
-
-    Piece p = get_piece(bs, move.from);
-    assert(is_empty(p) == false);
+    MoveUndo undo;
+    make_move_undo(bs, move, &undo);
+}
 
-    bool capture = false;
+// color is the color of the moving piece, constant in each caller
+static FORCE_INLINE void make_move_undo_color(BoardState *bs, Color color, Move move, MoveUndo *out_undo)
+{
+    assert(bs != NULL);
+    assert(out_undo != NULL);
+
+    Square from = move_from(move);
+    Square to = move_to(move);
+    assert(is_empty(piece_on(bs, from)) == false);
+    assert(get_color(piece_on(bs, from)) == color);
+    Piece p = create_piece(get_type(piece_on(bs, from)), color);
+    Piece captured = piece_on(bs, to);
+
+    // Everything make_move can't recompute backwards
+    out_undo->zobrist_hash = bs->zobrist_hash;
+    out_undo->pawn_key = bs->pawn_key;
+    out_undo->material_key = bs->material_key;
+    out_undo->non_pawn_key[0] = bs->non_pawn_key[0];
+    out_undo->non_pawn_key[1] = bs->non_pawn_key[1];
+    out_undo->halfmove_clock = bs->halfmove_clock;
+    out_undo->en_passant = bs->en_passant;
+    out_undo->castle_rights = bs->castle_rights;
+    out_undo->captured = captured;
+
+    bool capture = !is_empty(captured);
 
     // Reset en passant
-    if (bs->en_passant_y != NO_EN_PASSANT)
+    if (bs->en_passant != SQUARE_NONE)
     {
-        bs->zobrist_hash ^= zobrist_en_passant(bs->en_passant_y);
+        bs->zobrist_hash ^= zobrist_en_passant(square_to_pos(bs->en_passant).x);
+        bs->en_passant = SQUARE_NONE;
     }
-    bs->en_passant_x = NO_EN_PASSANT;
-    bs->en_passant_y = NO_EN_PASSANT;
 
     // Castle
-    if (is_king(p) && move_get_castle(&move) != CASTLE_NONE)
+    if (is_king(p) && move_get_castle(move) != CASTLE_NONE)
     {
-        if (move_get_castle(&move) == CASTLE_KINGSIDE)
-        {
-            // Move king
-            Pos kingPos = move.from;
-            kingPos.x = 6;
-            set_piece(bs, kingPos, p);
-            set_piece(bs, move.from, piece_empty());
-
-            // Move rook
-            set_piece(bs, (Pos){5, move.from.y}, create_piece(PT_ROOK, get_color(p)));
-            set_piece(bs, (Pos){7, move.from.y}, piece_empty());
-        }
-        else
-        {
-            // Move king
-            Pos kingPos = move.from;
-            kingPos.x = 2;
-            set_piece(bs, kingPos, p);
-            set_piece(bs, move.from, piece_empty());
-
-            // Move rook
-            set_piece(bs, (Pos){3, move.from.y}, create_piece(PT_ROOK, get_color(p)));
-            set_piece(bs, (Pos){0, move.from.y}, piece_empty());
-        }
+        bool king_side = move_get_castle(move) == CASTLE_KINGSIDE;
+        Piece rook = create_piece(PT_ROOK, color);
+
+        xor_piece(bs, from, p);
+        xor_piece(bs, to, p);
+        xor_piece(bs, king_side ? from + 3 : from - 4, rook);
+        xor_piece(bs, king_side ? from + 1 : from - 1, rook);
     }
     else
     {
-        if (!is_empty(get_piece(bs, move.to)))
-        {
-            capture = true;
-        }
-
         // Move piece
-        set_piece(bs, move.to, p);
-        set_piece(bs, move.from, piece_empty());
-
-        // En passant
-        if (is_pawn(p) && move_get_en_passant(&move))
+        if (capture)
         {
-            Pos enPassantPos = move.to;
-            enPassantPos.y = move.from.y;
-            set_piece(bs, enPassantPos, piece_empty());
-
-            capture = true;
+            xor_piece(bs, to, captured);
         }
+        xor_piece(bs, from, p);
+        xor_piece(bs, to, p);
 
-        // Promotion
-        if (is_pawn(p) && (move.to.y == 0 || move.to.y == 7) && move_get_promotion(&move) != PROMOTION_NONE)
+        if (is_pawn(p))
         {
-            set_piece(bs, move.to, create_piece(promotion_to_piece_type(move_get_promotion(&move)), get_color(p)));
-        }
+            // En passant, the captured pawn is behind the target square
+            if (move_get_en_passant(move))
+            {
+                xor_piece(bs, color == C_WHITE ? to + 8 : to - 8, create_piece(PT_PAWN, color == C_WHITE ? C_BLACK : C_WHITE));
+                capture = true;
+            }
 
-        // Double step set en passant
-        if (is_pawn(p) && abs(move.to.y - move.from.y) == 2)
-        {
-            bs->en_passant_x = move.to.x;
-            bs->en_passant_y = move.to.y + (get_color(p) == C_WHITE ? 1 : -1);
-            bs->zobrist_hash ^= zobrist_en_passant(bs->en_passant_y);
+            // Promotion
+            if (move_get_promotion(move) != PROMOTION_NONE)
+            {
+                xor_piece(bs, to, p);
+                xor_piece(bs, to, create_piece(promotion_to_piece_type(move_get_promotion(move)), color));
+            }
+
+            // Double step set en passant
+            if (abs(to - from) == 16)
+            {
+                bs->en_passant = (Square)((from + to) / 2);
+                bs->zobrist_hash ^= zobrist_en_passant(square_to_pos(to).x);
+            }
         }
     }
 
     // Update turn
-    bs->turn = get_color(p) == C_WHITE ? C_BLACK : C_WHITE;
+    bs->turn = color == C_WHITE ? C_BLACK : C_WHITE;
     bs->zobrist_hash ^= zobrist_black();
 
     // Update fullmove clock
@@ -532,254 +458,333 @@ void make_move(BoardState *bs, Move move)
     {
         bs->halfmove_clock = 0;
     }
-    else
+    else if (bs->halfmove_clock < UINT8_MAX)
     {
+        // Stops at 255, far past the 50 move rule, instead of wrapping to 0
         bs->halfmove_clock++;
     }
 
     // Update castling rights
-    if (is_king(p))
+    set_castle_rights(bs, bs->castle_rights & castle_rights_kept(from) & castle_rights_kept(to));
+}
+
+static void make_move_undo_white(BoardState *bs, Move move, MoveUndo *out_undo)
+{
+    make_move_undo_color(bs, C_WHITE, move, out_undo);
+}
+
+static void make_move_undo_black(BoardState *bs, Move move, MoveUndo *out_undo)
+{
+    make_move_undo_color(bs, C_BLACK, move, out_undo);
+}
+
+void make_move_undo(BoardState *bs, Move move, MoveUndo *out_undo)
+{
+    assert(bs != NULL);
+
+    if (bs->color_bb[C_WHITE - 1] & square_bb(move_from(move)))
     {
-        update_castle_right(bs, get_color(p), true, false);
-        update_castle_right(bs, get_color(p), false, false);
+        make_move_undo_white(bs, move, out_undo);
     }
-    else if (is_rook(p))
+    else
     {
-        if (move.from.x == 7)
-        {
-            update_castle_right(bs, get_color(p), true, false);
-        }
-        else if (move.from.x == 0)
-        {
-            update_castle_right(bs, get_color(p), false, false);
-        }
+        make_move_undo_black(bs, move, out_undo);
     }
+}
+
+static FORCE_INLINE void unmake_move_color(BoardState *bs, Color color, Move move, MoveUndo *undo)
+{
+    assert(bs != NULL);
+    assert(undo != NULL);
+
+    // The hash is restored from undo, only the bitboards need to be reverted
+    Square from = move_from(move);
+    Square to = move_to(move);
+    assert(is_empty(piece_on(bs, to)) == false);
+    assert(get_color(piece_on(bs, to)) == color);
+    Piece p = create_piece(get_type(piece_on(bs, to)), color);
 
-    // Castling rights rook captured
-    if (capture)
+    // Castle
+    if (is_king(p) && move_get_castle(move) != CASTLE_NONE)
     {
-        if (move.to.x == 0 && move.to.y == 7)
-        {
-            update_castle_right(bs, C_WHITE, false, false);
-        }
-        else if (move.to.x == 7 && move.to.y == 7)
+        bool king_side = move_get_castle(move) == CASTLE_KINGSIDE;
+        Piece rook = create_piece(PT_ROOK, color);
+
+        toggle_piece(bs, to, p);
+        toggle_piece(bs, from, p);
+        toggle_piece(bs, king_side ? from + 1 : from - 1, rook);
+        toggle_piece(bs, king_side ? from + 3 : from - 4, rook);
+    }
+    else
+    {
+        toggle_piece(bs, to, p);
+
+        // Promotion
+        if (move_get_promotion(move) != PROMOTION_NONE)
         {
-            update_castle_right(bs, C_WHITE, true, false);
+            p = create_piece(PT_PAWN, color);
         }
-        else if (move.to.x == 0 && move.to.y == 0)
+
+        // Move piece back, restore captured piece
+        toggle_piece(bs, from, p);
+        if (!is_empty(undo->captured))
         {
-            update_castle_right(bs, C_BLACK, false, false);
+            toggle_piece(bs, to, undo->captured);
         }
-        else if (move.to.x == 7 && move.to.y == 0)
+
+        // En passant
+        if (is_pawn(p) && move_get_en_passant(move))
         {
-            update_castle_right(bs, C_BLACK, true, false);
+            toggle_piece(bs, color == C_WHITE ? to + 8 : to - 8, create_piece(PT_PAWN, color == C_WHITE ? C_BLACK : C_WHITE));
         }
     }
-}
 
-bool is_in_check(BoardState *bs, Color color)
-{
-    assert(bs != NULL);
+    // Update turn
+    bs->turn = color;
 
-    // Find king
-    int8_t king_index;
-    int8_t *king_len;
-    pieces_offset(&bs->pieces, PT_KING, color, &king_index, &king_len);
-    // No king found
-    if (*king_len == 0)
+    // Update fullmove clock
+    if (color == C_BLACK)
     {
-        return false;
+        bs->fullmove_number--;
     }
-    Pos king_pos = bs->pieces.list[king_index];
 
-    // Check if any piece can attack the king
-    bool attack_map[8][8];
-    generate_attack_map(bs, color == C_WHITE ? C_BLACK : C_WHITE, attack_map);
+    bs->halfmove_clock = undo->halfmove_clock;
+    bs->en_passant = undo->en_passant;
+    bs->castle_rights = undo->castle_rights;
+    bs->zobrist_hash = undo->zobrist_hash;
+    bs->pawn_key = undo->pawn_key;
+    bs->material_key = undo->material_key;
+    bs->non_pawn_key[0] = undo->non_pawn_key[0];
+    bs->non_pawn_key[1] = undo->non_pawn_key[1];
+}
 
-    return attack_map[king_pos.x][king_pos.y];
+static void unmake_move_white(BoardState *bs, Move move, MoveUndo *undo)
+{
+    unmake_move_color(bs, C_WHITE, move, undo);
 }
 
-// Move generation //
+static void unmake_move_black(BoardState *bs, Move move, MoveUndo *undo)
+{
+    unmake_move_color(bs, C_BLACK, move, undo);
+}
 
-static void generate_step_pseudo_move(BoardState *bs, Pos pos, Pos target_pos, Array(Move) * out_moves)
+void unmake_move(BoardState *bs, Move move, MoveUndo *undo)
 {
     assert(bs != NULL);
-    assert(out_moves != NULL);
 
-    // Out of board
-    if (target_pos.x < 0 || target_pos.x > 7 || target_pos.y < 0 || target_pos.y > 7)
+    if (bs->color_bb[C_WHITE - 1] & square_bb(move_to(move)))
     {
-        return;
+        unmake_move_white(bs, move, undo);
     }
-
-    // Allied piece
-    if (get_color(get_piece(bs, target_pos)) == get_color(get_piece(bs, pos)))
+    else
     {
-        return;
+        unmake_move_black(bs, move, undo);
     }
-
-    Move move = move_create(pos, target_pos, PROMOTION_NONE, CASTLE_NONE, false);
-    array_push(*out_moves, move);
 }
 
-static void generate_slide_pseudo_moves(BoardState *bs, Pos pos, int8_t direction_x, int8_t direction_y,
-                                        Array(Move) * out_moves)
+CPU_DEFINE_ISA_KERNELS(Bitboard, attackers_to, (BoardState * bs, Square sq, Bitboard occupied), (bs, sq, occupied))
+
+Bitboard attackers_to(BoardState *bs, Square sq, Bitboard occupied)
 {
     assert(bs != NULL);
-    assert(out_moves != NULL);
+    assert(sq >= 0 && sq < 64);
 
-    for (Pos target_pos = {pos.x + direction_x, pos.y + direction_y};
-         target_pos.x >= 0 && target_pos.x <= 7 && target_pos.y >= 0 && target_pos.y <= 7;
-         target_pos.x += direction_x, target_pos.y += direction_y)
-    {
-        Piece p = get_piece(bs, target_pos);
-        if (is_empty(p))
-        {
-            Move move = move_create(pos, target_pos, PROMOTION_NONE, CASTLE_NONE, false);
-            array_push(*out_moves, move);
-        }
-        else
-        {
-            // Capture
-            if (get_color(p) != get_color(get_piece(bs, pos)))
-            {
-                Move move = move_create(pos, target_pos, PROMOTION_NONE, CASTLE_NONE, false);
-                array_push(*out_moves, move);
-            }
+    CPU_DISPATCH_ISA(attackers_to, (bs, sq, occupied));
+}
 
-            break;
-        }
-    }
+static FORCE_INLINE bool is_square_attacked_body(BoardState *bs, Square sq, Color by_color)
+{
+    // Probe outward from the square, a piece attacks sq if it stands on one of sq's attacks of the same kind
+    Bitboard occupied = get_occupied_bitboard(bs);
+    Bitboard queens = get_pieces_bitboard(bs, PT_QUEEN, by_color);
+
+    return (pawn_attacks(by_color == C_WHITE ? C_BLACK : C_WHITE, sq) & get_pieces_bitboard(bs, PT_PAWN, by_color)) ||
+           (knight_attacks(sq) & get_pieces_bitboard(bs, PT_KNIGHT, by_color)) ||
+           (king_attacks(sq) & get_pieces_bitboard(bs, PT_KING, by_color)) ||
+           (bishop_attacks(sq, occupied) & (get_pieces_bitboard(bs, PT_BISHOP, by_color) | queens)) ||
+           (rook_attacks(sq, occupied) & (get_pieces_bitboard(bs, PT_ROOK, by_color) | queens));
 }
 
-// If final rank, add all promotions
-static void generate_pawn_pseudo_moves_step(Pos pos, Pos target_pos, int8_t ending_y, bool en_passant,
-                                            Array(Move) * out_moves)
+CPU_DEFINE_ISA_KERNELS(bool, is_square_attacked, (BoardState * bs, Square sq, Color by_color), (bs, sq, by_color))
+
+bool is_square_attacked(BoardState *bs, Square sq, Color by_color)
 {
-    assert(out_moves != NULL);
+    assert(bs != NULL);
+    assert(sq >= 0 && sq < 64);
 
-    // Final rank, all promotions
-    if (target_pos.y == ending_y)
-    {
-        Move move = move_create(pos, target_pos, PROMOTION_QUEEN, CASTLE_NONE, en_passant);
-        array_push(*out_moves, move);
-        move = move_create(pos, target_pos, PROMOTION_ROOK, CASTLE_NONE, en_passant);
-        array_push(*out_moves, move);
-        move = move_create(pos, target_pos, PROMOTION_BISHOP, CASTLE_NONE, en_passant);
-        array_push(*out_moves, move);
-        move = move_create(pos, target_pos, PROMOTION_KNIGHT, CASTLE_NONE, en_passant);
-        array_push(*out_moves, move);
-    }
-    else
-    {
-        Move move = move_create(pos, target_pos, PROMOTION_NONE, CASTLE_NONE, en_passant);
-        array_push(*out_moves, move);
-    }
+    CPU_DISPATCH_ISA(is_square_attacked, (bs, sq, by_color));
 }
 
-static void generate_pawn_pseudo_moves_for_color(BoardState *bs, Pos pos, int8_t direction, int8_t starting_y,
-                                                 int8_t ending_y, Array(Move) * out_moves)
+bool is_in_check(BoardState *bs, Color color)
 {
-    Pos forward_pos = {pos.x, pos.y + direction};
-    if (forward_pos.y >= 0 && forward_pos.y <= 7 && get_piece(bs, forward_pos) == piece_empty())
-    {
-        generate_pawn_pseudo_moves_step(pos, forward_pos, ending_y, false, out_moves);
+    assert(bs != NULL);
 
-        // Double step
-        if (pos.y == starting_y)
-        {
-            Pos double_step_pos = {pos.x, pos.y + 2 * direction};
-            if (get_piece(bs, double_step_pos) == piece_empty())
-            {
-                Move move = move_create(pos, double_step_pos, PROMOTION_NONE, CASTLE_NONE, false);
-                array_push(*out_moves, move);
-            }
-        }
+    // Find king
+    Bitboard king = get_pieces_bitboard(bs, PT_KING, color);
+    // No king found
+    if (king == BB_EMPTY)
+    {
+        return false;
     }
 
-    // Left
-    if (pos.x != 0)
-    {
-        Pos left = (Pos){pos.x - 1, pos.y + direction};
+    return is_square_attacked(bs, lsb(king), color == C_WHITE ? C_BLACK : C_WHITE);
+}
 
-        // Capture
-        if (!is_empty(get_piece(bs, left)) && get_color(get_piece(bs, left)) != get_color(get_piece(bs, pos)))
-        {
-            generate_pawn_pseudo_moves_step(pos, left, ending_y, false, out_moves);
-        }
+// Move generation //
 
-        // En passant
-        if (bs->en_passant_x == pos.x - 1 && bs->en_passant_y == pos.y + direction)
-        {
-            generate_pawn_pseudo_moves_step(pos, left, ending_y, true, out_moves);
-        }
+bool move_is_noisy(BoardState *bs, Move move)
+{
+    assert(bs != NULL);
+
+    return !is_empty(piece_on(bs, move_to(move))) || move_get_en_passant(move) ||
+           move_get_promotion(move) != PROMOTION_NONE;
+}
+
+// One move for each target square
+static void push_moves(Square from, Bitboard targets, MoveList *out_moves)
+{
+    assert(out_moves != NULL);
+
+    while (targets != BB_EMPTY)
+    {
+        Move move = move_create(from, pop_lsb(&targets), PROMOTION_NONE, CASTLE_NONE, false);
+        move_list_push(out_moves, move);
     }
+}
+
+// Every target square not occupied by an allied piece
+static Bitboard not_allied(BoardState *bs, Pos pos)
+{
+    return ~get_color_bitboard(bs, get_color(get_piece(bs, pos)));
+}
+
+// If final rank, add all promotions
+static void generate_pawn_pseudo_moves_step(Square from, Square to, int8_t ending_y, bool en_passant,
+                                            MoveList *out_moves)
+{
+    assert(out_moves != NULL);
 
-    // Right
-    if (pos.x != 7)
+    // Final rank, all promotions
+    if (square_to_pos(to).y == ending_y)
+    {
+        Move move = move_create(from, to, PROMOTION_QUEEN, CASTLE_NONE, en_passant);
+        move_list_push(out_moves, move);
+        move = move_create(from, to, PROMOTION_ROOK, CASTLE_NONE, en_passant);
+        move_list_push(out_moves, move);
+        move = move_create(from, to, PROMOTION_BISHOP, CASTLE_NONE, en_passant);
+        move_list_push(out_moves, move);
+        move = move_create(from, to, PROMOTION_KNIGHT, CASTLE_NONE, en_passant);
+        move_list_push(out_moves, move);
+    }
+    else
     {
-        Pos right = (Pos){pos.x + 1, pos.y + direction};
+        Move move = move_create(from, to, PROMOTION_NONE, CASTLE_NONE, en_passant);
+        move_list_push(out_moves, move);
+    }
+}
 
-        // Capture
-        if (!is_empty(get_piece(bs, right)) && get_color(get_piece(bs, right)) != get_color(get_piece(bs, pos)))
-        {
-            generate_pawn_pseudo_moves_step(pos, right, ending_y, false, out_moves);
-        }
+static void generate_castle_moves(BoardState *bs, Pos pos, MoveList *out_moves)
+{
+    assert(bs != NULL);
+    assert(out_moves != NULL);
 
-        // En passant
-        if (bs->en_passant_x == pos.x + 1 && bs->en_passant_y == pos.y + direction)
-        {
-            generate_pawn_pseudo_moves_step(pos, right, ending_y, true, out_moves);
-        }
+    Color color = get_color(get_piece(bs, pos));
+    Bitboard occupied = get_occupied_bitboard(bs);
+    Bitboard kingside_between = square_bb(pos_to_square((Pos){5, pos.y})) | square_bb(pos_to_square((Pos){6, pos.y}));
+    Bitboard queenside_between = square_bb(pos_to_square((Pos){3, pos.y})) |
+                                 square_bb(pos_to_square((Pos){2, pos.y})) | square_bb(pos_to_square((Pos){1, pos.y}));
+
+    bool can_castle_kingside = has_castle_right(bs, color, true) &&
+                               (occupied & kingside_between) == BB_EMPTY;
+    bool can_castle_queenside = has_castle_right(bs, color, false) &&
+                                (occupied & queenside_between) == BB_EMPTY;
+
+    Color enemy = color == C_WHITE ? C_BLACK : C_WHITE;
+    bool king_attacked = (can_castle_kingside || can_castle_queenside) &&
+                         is_square_attacked_body(bs, pos_to_square((Pos){4, pos.y}), enemy);
+
+    // The king can't castle out of, through or into check
+    if (can_castle_kingside && !king_attacked && !is_square_attacked_body(bs, pos_to_square((Pos){5, pos.y}), enemy) &&
+        !is_square_attacked_body(bs, pos_to_square((Pos){6, pos.y}), enemy))
+    {
+        Square from = pos_to_square(pos);
+        Move move = move_create(from, from + 2, PROMOTION_NONE, CASTLE_KINGSIDE, false);
+        move_list_push(out_moves, move);
+    }
+
+    if (can_castle_queenside && !king_attacked && !is_square_attacked_body(bs, pos_to_square((Pos){3, pos.y}), enemy) &&
+        !is_square_attacked_body(bs, pos_to_square((Pos){2, pos.y}), enemy))
+    {
+        Square from = pos_to_square(pos);
+        Move move = move_create(from, from - 2, PROMOTION_NONE, CASTLE_QUEENSIDE, false);
+        move_list_push(out_moves, move);
     }
 }
 
-void generate_pseudo_moves(BoardState *bs, Color color, Array(Move) * out_moves)
+void generate_pseudo_moves(BoardState *bs, Color color, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
 
-    int8_t index;
-    int8_t *len;
+    Bitboard pieces = get_pieces_bitboard(bs, PT_PAWN, color);
+    while (pieces != BB_EMPTY)
+    {
+        generate_pawn_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
+    }
 
-    pieces_offset(&bs->pieces, PT_PAWN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    pieces = get_pieces_bitboard(bs, PT_KNIGHT, color);
+    while (pieces != BB_EMPTY)
     {
-        generate_pawn_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        generate_knight_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
     }
 
-    pieces_offset(&bs->pieces, PT_KNIGHT, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    pieces = get_pieces_bitboard(bs, PT_BISHOP, color);
+    while (pieces != BB_EMPTY)
     {
-        generate_knight_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        generate_bishop_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
     }
 
-    pieces_offset(&bs->pieces, PT_BISHOP, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    pieces = get_pieces_bitboard(bs, PT_ROOK, color);
+    while (pieces != BB_EMPTY)
     {
-        generate_bishop_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        generate_rook_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
     }
 
-    pieces_offset(&bs->pieces, PT_ROOK, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    pieces = get_pieces_bitboard(bs, PT_QUEEN, color);
+    while (pieces != BB_EMPTY)
     {
-        generate_rook_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        generate_queen_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
     }
 
-    pieces_offset(&bs->pieces, PT_QUEEN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    pieces = get_pieces_bitboard(bs, PT_KING, color);
+    while (pieces != BB_EMPTY)
     {
-        generate_queen_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        generate_king_pseudo_moves(bs, square_to_pos(pop_lsb(&pieces)), out_moves);
     }
+}
 
-    pieces_offset(&bs->pieces, PT_KING, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+// Without a king there are no checks or pins, the pseudo moves are filtered by type instead
+static void generate_pseudo_moves_type(BoardState *bs, Color color, MoveGenType type, MoveList *out_moves)
+{
+    size_t begin = out_moves->len;
+    generate_pseudo_moves(bs, color, out_moves);
+    if (type == GEN_ALL)
     {
-        generate_king_pseudo_moves(bs, bs->pieces.list[i], out_moves);
+        return;
+    }
+
+    size_t len = begin;
+    for (size_t i = begin; i < out_moves->len; i++)
+    {
+        if (move_is_noisy(bs, out_moves->moves[i]) == (type == GEN_NOISY))
+        {
+            out_moves->moves[len++] = out_moves->moves[i];
+        }
     }
+    out_moves->len = len;
 }
 
-void generate_piece_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_piece_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
@@ -814,357 +819,744 @@ void generate_piece_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_move
     }
 }
 
-void generate_pawn_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_pawn_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
     assert(is_pawn(get_piece(bs, pos)));
 
-    if (get_color(get_piece(bs, pos)) == C_WHITE)
-    {
-        generate_pawn_pseudo_moves_for_color(bs, pos, -1, 6, 0, out_moves);
-    }
-    else
-    {
-        generate_pawn_pseudo_moves_for_color(bs, pos, 1, 1, 7, out_moves);
-    }
-}
-void generate_king_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
-{
-    assert(bs != NULL);
-    assert(out_moves != NULL);
-    assert(is_king(get_piece(bs, pos)));
-
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 1, pos.y - 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x, pos.y - 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 1, pos.y - 1}, out_moves);
-
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 1, pos.y}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 1, pos.y}, out_moves);
-
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 1, pos.y + 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x, pos.y + 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 1, pos.y + 1}, out_moves);
-
-    // Castle
     Color color = get_color(get_piece(bs, pos));
-    bool can_castle_kingside = (color == C_WHITE ? bs->white_king_side_castle : bs->black_king_side_castle) &&
-                               is_empty(get_piece(bs, (Pos){5, pos.y})) && is_empty(get_piece(bs, (Pos){6, pos.y}));
-    bool can_castle_queenside = (color == C_WHITE ? bs->white_queen_side_castle : bs->black_queen_side_castle) &&
-                                is_empty(get_piece(bs, (Pos){3, pos.y})) && is_empty(get_piece(bs, (Pos){2, pos.y})) &&
-                                is_empty(get_piece(bs, (Pos){1, pos.y}));
+    Color enemy = color == C_WHITE ? C_BLACK : C_WHITE;
+    int8_t starting_y = color == C_WHITE ? 6 : 1;
+    int8_t ending_y = color == C_WHITE ? 0 : 7;
+
+    Square sq = pos_to_square(pos);
+    Bitboard empty = ~get_occupied_bitboard(bs);
 
-    // No need to compute attack map if can't castle
-    if (!can_castle_kingside && !can_castle_queenside)
+    // Forward, shifting off the board gives an empty bitboard
+    Bitboard forward = (color == C_WHITE ? square_bb(sq) >> 8 : square_bb(sq) << 8) & empty;
+    if (forward != BB_EMPTY)
     {
-        return;
-    }
+        generate_pawn_pseudo_moves_step(sq, lsb(forward), ending_y, false, out_moves);
 
-    bool attack_map[8][8];
-    generate_attack_map(bs, color == C_WHITE ? C_BLACK : C_WHITE, attack_map);
+        // Double step
+        if (pos.y == starting_y)
+        {
+            Bitboard double_step = (color == C_WHITE ? forward >> 8 : forward << 8) & empty;
+            if (double_step != BB_EMPTY)
+            {
+                Move move = move_create(sq, lsb(double_step), PROMOTION_NONE, CASTLE_NONE, false);
+                move_list_push(out_moves, move);
+            }
+        }
+    }
 
-    if (can_castle_kingside && !attack_map[4][pos.y] && !attack_map[5][pos.y] && !attack_map[6][pos.y])
+    // Captures
+    Bitboard attacks = pawn_attacks(color, sq);
+    Bitboard captures = attacks & get_color_bitboard(bs, enemy);
+    while (captures != BB_EMPTY)
     {
-        Move move = move_create(pos, (Pos){pos.x + 2, pos.y}, PROMOTION_NONE, CASTLE_KINGSIDE, false);
-        array_push(*out_moves, move);
+        generate_pawn_pseudo_moves_step(sq, pop_lsb(&captures), ending_y, false, out_moves);
     }
 
-    if (can_castle_queenside && !attack_map[4][pos.y] && !attack_map[3][pos.y] && !attack_map[2][pos.y])
+    // En passant
+    if (bs->en_passant != SQUARE_NONE && (attacks & square_bb(bs->en_passant)))
     {
-        Move move = move_create(pos, (Pos){pos.x - 2, pos.y}, PROMOTION_NONE, CASTLE_QUEENSIDE, false);
-        array_push(*out_moves, move);
+        generate_pawn_pseudo_moves_step(sq, bs->en_passant, ending_y, true, out_moves);
     }
 }
-void generate_queen_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_king_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
-    assert(is_queen(get_piece(bs, pos)));
+    assert(is_king(get_piece(bs, pos)));
 
-    generate_slide_pseudo_moves(bs, pos, 0, 1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 0, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 1, 0, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, 0, out_moves);
+    push_moves(pos_to_square(pos), king_attacks(pos_to_square(pos)) & not_allied(bs, pos), out_moves);
+    generate_castle_moves(bs, pos, out_moves);
+}
+void generate_queen_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
+{
+    assert(bs != NULL);
+    assert(out_moves != NULL);
+    assert(is_queen(get_piece(bs, pos)));
 
-    generate_slide_pseudo_moves(bs, pos, 1, 1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 1, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, 1, out_moves);
+    Bitboard attacks = queen_attacks(pos_to_square(pos), get_occupied_bitboard(bs));
+    push_moves(pos_to_square(pos), attacks & not_allied(bs, pos), out_moves);
 }
-void generate_rook_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_rook_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
     assert(is_rook(get_piece(bs, pos)));
 
-    generate_slide_pseudo_moves(bs, pos, 0, 1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 0, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 1, 0, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, 0, out_moves);
+    Bitboard attacks = rook_attacks(pos_to_square(pos), get_occupied_bitboard(bs));
+    push_moves(pos_to_square(pos), attacks & not_allied(bs, pos), out_moves);
 }
-void generate_bishop_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_bishop_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
     assert(is_bishop(get_piece(bs, pos)));
 
-    generate_slide_pseudo_moves(bs, pos, 1, 1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, 1, -1, out_moves);
-    generate_slide_pseudo_moves(bs, pos, -1, 1, out_moves);
+    Bitboard attacks = bishop_attacks(pos_to_square(pos), get_occupied_bitboard(bs));
+    push_moves(pos_to_square(pos), attacks & not_allied(bs, pos), out_moves);
 }
 
-void generate_knight_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves)
+void generate_knight_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves)
 {
     assert(bs != NULL);
     assert(out_moves != NULL);
     assert(is_knight(get_piece(bs, pos)));
 
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 2, pos.y - 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 2, pos.y + 1}, out_moves);
+    push_moves(pos_to_square(pos), knight_attacks(pos_to_square(pos)) & not_allied(bs, pos), out_moves);
+}
+
+// Pieces of blocker_color that are alone between king_sq and a slider of slider_color
+static Bitboard slider_blockers(BoardState *bs, Square king_sq, Color slider_color, Color blocker_color)
+{
+    Bitboard occupied = get_occupied_bitboard(bs);
+    Bitboard queens = get_pieces_bitboard(bs, PT_QUEEN, slider_color);
 
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 2, pos.y - 1}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 2, pos.y + 1}, out_moves);
+    // Sliders that would attack the king on an empty board
+    Bitboard snipers = (rook_attacks(king_sq, BB_EMPTY) & (get_pieces_bitboard(bs, PT_ROOK, slider_color) | queens)) |
+                       (bishop_attacks(king_sq, BB_EMPTY) & (get_pieces_bitboard(bs, PT_BISHOP, slider_color) | queens));
 
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 1, pos.y - 2}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 1, pos.y - 2}, out_moves);
+    Bitboard blockers = BB_EMPTY;
+    while (snipers != BB_EMPTY)
+    {
+        Bitboard between = between_bb(king_sq, pop_lsb(&snipers)) & occupied;
 
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x + 1, pos.y + 2}, out_moves);
-    generate_step_pseudo_move(bs, pos, (Pos){pos.x - 1, pos.y + 2}, out_moves);
+        // Exactly one piece in between
+        if ((between & (between - 1)) == BB_EMPTY)
+        {
+            blockers |= between & get_color_bitboard(bs, blocker_color);
+        }
+    }
+
+    return blockers;
 }
 
-void generate_legal_moves(BoardState *bs, Color color, Array(Move) * out_moves)
+// Own pieces pinned to the king by an enemy slider
+static FORCE_INLINE Bitboard pinned_pieces(BoardState *bs, Square king_sq, Color color)
 {
-    assert(bs != NULL);
-    assert(out_moves != NULL);
+    return slider_blockers(bs, king_sq, color == C_WHITE ? C_BLACK : C_WHITE, color);
+}
+
+// En passant removes two pieces from the king's lines (e.g. both pawns on the king's rank), so it is checked on
+// the resulting occupancy
+static FORCE_INLINE bool is_en_passant_legal(BoardState *bs, Square king_sq, Square from, Square to, Color color)
+{
+    Color enemy = color == C_WHITE ? C_BLACK : C_WHITE;
+    Square captured = color == C_WHITE ? to + 8 : to - 8;
+
+    Bitboard occupied = (get_occupied_bitboard(bs) ^ square_bb(from) ^ square_bb(captured)) | square_bb(to);
+    Bitboard attackers =
+        attackers_to_body(bs, king_sq, occupied) & get_color_bitboard(bs, enemy) & ~square_bb(captured);
+
+    return attackers == BB_EMPTY;
+}
+
+static FORCE_INLINE void generate_legal_pawn_moves(BoardState *bs, Square king_sq, Color color, Bitboard pinned,
+                                                   Bitboard target_mask, MoveGenType type, MoveList *out_moves)
+{
+    int8_t starting_y = color == C_WHITE ? 6 : 1;
+    int8_t ending_y = color == C_WHITE ? 0 : 7;
 
-    Array(Move) pseudo_moves = array_create_size(Move, 32);
-    generate_pseudo_moves(bs, color, &pseudo_moves);
+    Bitboard empty = ~get_occupied_bitboard(bs);
+    Bitboard enemies = get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+    Bitboard promotion_rank = BB_RANK(ending_y);
 
-    // Filter out moves that put the king into check
-    for (size_t i = 0; i < array_len(pseudo_moves); i++)
+    // Pushes are quiet unless they promote, captures are always noisy
+    Bitboard push_mask = BB_EMPTY;
+    if (type != GEN_NOISY)
     {
-        // Fix bug
-        BoardState new_bs = *bs;
+        push_mask |= ~promotion_rank;
+    }
+    if (type != GEN_QUIET)
+    {
+        push_mask |= promotion_rank;
+    }
+    Bitboard capture_mask = type != GEN_QUIET ? enemies : BB_EMPTY;
+
+    Square en_passant_sq = type != GEN_QUIET ? bs->en_passant : SQUARE_NONE;
+
+    Bitboard pawns = get_pieces_bitboard(bs, PT_PAWN, color);
+    while (pawns != BB_EMPTY)
+    {
+        Square from = pop_lsb(&pawns);
+
+        // A pinned pawn can only move along the pin
+        Bitboard allowed = target_mask;
+        if (pinned & square_bb(from))
+        {
+            allowed &= line_bb(king_sq, from);
+        }
+
+        Bitboard single_step = (color == C_WHITE ? square_bb(from) >> 8 : square_bb(from) << 8) & empty;
+        Bitboard double_step = BB_EMPTY;
+        if (square_to_pos(from).y == starting_y)
+        {
+            double_step = (color == C_WHITE ? single_step >> 8 : single_step << 8) & empty;
+        }
+
+        Bitboard targets =
+            ((single_step | double_step) & push_mask & allowed) | (pawn_attacks(color, from) & capture_mask & allowed);
+        while (targets != BB_EMPTY)
+        {
+            generate_pawn_pseudo_moves_step(from, pop_lsb(&targets), ending_y, false, out_moves);
+        }
 
-        make_move(&new_bs, pseudo_moves[i]);
-        if (!is_in_check(&new_bs, color))
+        if (en_passant_sq != SQUARE_NONE && (pawn_attacks(color, from) & square_bb(en_passant_sq)) &&
+            is_en_passant_legal(bs, king_sq, from, en_passant_sq, color))
         {
-            array_push(*out_moves, pseudo_moves[i]);
+            Move move = move_create(from, en_passant_sq, PROMOTION_NONE, CASTLE_NONE, true);
+            move_list_push(out_moves, move);
         }
     }
-    array_free(pseudo_moves);
 }
 
-// Attack Map generation //
-static void generate_slide_attack_map(BoardState *bs, Pos pos, int8_t direction_x, int8_t direction_y,
-                                      bool out_map[8][8])
+// Captures land on enemies, quiet moves on empty squares
+static FORCE_INLINE Bitboard gen_type_mask(BoardState *bs, Color color, MoveGenType type)
 {
-    assert(bs != NULL);
-    assert(out_map != NULL);
+    switch (type)
+    {
+    case GEN_NOISY:
+        return get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+    case GEN_QUIET:
+        return ~get_occupied_bitboard(bs);
+    case GEN_ALL:
+    default:
+        return ~get_color_bitboard(bs, color);
+    }
+}
 
-    for (Pos target_pos = {pos.x + direction_x, pos.y + direction_y};
-         target_pos.x >= 0 && target_pos.x <= 7 && target_pos.y >= 0 && target_pos.y <= 7;
-         target_pos.x += direction_x, target_pos.y += direction_y)
+// Pawns, knights and sliders, landing on target_mask and staying on their pin line
+static FORCE_INLINE void generate_legal_piece_moves(BoardState *bs, Square king_sq, Color color, Bitboard pinned,
+                                                    Bitboard target_mask, MoveGenType type, MoveList *out_moves)
+{
+    // Pawns apply the type themselves, a push to the last rank is noisy
+    generate_legal_pawn_moves(bs, king_sq, color, pinned, target_mask, type, out_moves);
+
+    target_mask &= gen_type_mask(bs, color, type);
+    Bitboard occupied = get_occupied_bitboard(bs);
+
+    // A pinned knight can never move
+    Bitboard pieces = get_pieces_bitboard(bs, PT_KNIGHT, color) & ~pinned;
+    while (pieces != BB_EMPTY)
+    {
+        Square from = pop_lsb(&pieces);
+        push_moves(from, knight_attacks(from) & target_mask, out_moves);
+    }
+
+    for (PieceType pt = PT_BISHOP; pt <= PT_QUEEN; pt++)
     {
+        pieces = get_pieces_bitboard(bs, pt, color);
+        while (pieces != BB_EMPTY)
+        {
+            Square from = pop_lsb(&pieces);
+
+            Bitboard attacks = BB_EMPTY;
+            if (pt != PT_ROOK)
+            {
+                attacks |= bishop_attacks(from, occupied);
+            }
+            if (pt != PT_BISHOP)
+            {
+                attacks |= rook_attacks(from, occupied);
+            }
 
-        out_map[target_pos.x][target_pos.y] = true;
+            // A pinned piece can only move along the pin
+            if (pinned & square_bb(from))
+            {
+                attacks &= line_bb(king_sq, from);
+            }
+
+            push_moves(from, attacks & target_mask, out_moves);
+        }
+    }
+}
 
-        if (!is_empty(get_piece(bs, target_pos)))
+// King steps, squares are checked without the king so it can't step back along a checking ray
+static FORCE_INLINE void generate_legal_king_moves(BoardState *bs, Square king_sq, Color color, Bitboard target_mask,
+                                                   MoveList *out_moves)
+{
+    Bitboard enemies = get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+    Bitboard occupied_without_king = get_occupied_bitboard(bs) ^ square_bb(king_sq);
+
+    Bitboard targets = king_attacks(king_sq) & target_mask;
+    while (targets != BB_EMPTY)
+    {
+        Square to = pop_lsb(&targets);
+        if ((attackers_to_body(bs, to, occupied_without_king) & enemies) == BB_EMPTY)
         {
-            break;
+            Move move = move_create(king_sq, to, PROMOTION_NONE, CASTLE_NONE, false);
+            move_list_push(out_moves, move);
         }
     }
 }
-static void generate_queen_attack_map(BoardState *bs, Pos pos, bool out_map[8][8])
+
+// In check: king steps to safe squares, then with a single checker, capturing it or blocking its ray
+static FORCE_INLINE void generate_evasions_type(BoardState *bs, Color color, Square king_sq, Bitboard checkers,
+                                                MoveGenType type, MoveList *out_moves)
 {
-    assert(bs != NULL);
-    assert(out_map != NULL);
-    assert(is_queen(get_piece(bs, pos)));
+    assert(checkers != BB_EMPTY);
+
+    generate_legal_king_moves(bs, king_sq, color, gen_type_mask(bs, color, type), out_moves);
 
-    generate_slide_attack_map(bs, pos, 0, 1, out_map);
-    generate_slide_attack_map(bs, pos, 0, -1, out_map);
-    generate_slide_attack_map(bs, pos, 1, 0, out_map);
-    generate_slide_attack_map(bs, pos, -1, 0, out_map);
+    // In double check only the king can move
+    if ((checkers & (checkers - 1)) != BB_EMPTY)
+    {
+        return;
+    }
 
-    generate_slide_attack_map(bs, pos, 1, 1, out_map);
-    generate_slide_attack_map(bs, pos, -1, -1, out_map);
-    generate_slide_attack_map(bs, pos, 1, -1, out_map);
-    generate_slide_attack_map(bs, pos, -1, 1, out_map);
+    Bitboard target_mask = checkers | between_bb(king_sq, lsb(checkers));
+    generate_legal_piece_moves(bs, king_sq, color, pinned_pieces(bs, king_sq, color), target_mask, type, out_moves);
 }
-static void generate_rook_attack_map(BoardState *bs, Pos pos, bool out_map[8][8])
+
+static FORCE_INLINE void generate_legal_color(BoardState *bs, Color color, MoveGenType type, MoveList *out_moves)
 {
     assert(bs != NULL);
-    assert(out_map != NULL);
-    assert(is_rook(get_piece(bs, pos)));
+    assert(out_moves != NULL);
+
+    Bitboard king = get_pieces_bitboard(bs, PT_KING, color);
+    // No king, every move is legal
+    if (king == BB_EMPTY)
+    {
+        generate_pseudo_moves_type(bs, color, type, out_moves);
+        return;
+    }
 
-    generate_slide_attack_map(bs, pos, 0, 1, out_map);
-    generate_slide_attack_map(bs, pos, 0, -1, out_map);
-    generate_slide_attack_map(bs, pos, 1, 0, out_map);
-    generate_slide_attack_map(bs, pos, -1, 0, out_map);
+    Square king_sq = lsb(king);
+    Bitboard enemies = get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+    Bitboard checkers = attackers_to_body(bs, king_sq, get_occupied_bitboard(bs)) & enemies;
+    if (checkers != BB_EMPTY)
+    {
+        generate_evasions_type(bs, color, king_sq, checkers, type, out_moves);
+        return;
+    }
+
+    Bitboard pinned = pinned_pieces(bs, king_sq, color);
+    generate_legal_piece_moves(bs, king_sq, color, pinned, ~get_color_bitboard(bs, color), type, out_moves);
+    generate_legal_king_moves(bs, king_sq, color, gen_type_mask(bs, color, type), out_moves);
+
+    if (type != GEN_NOISY)
+    {
+        generate_castle_moves(bs, square_to_pos(king_sq), out_moves);
+    }
 }
-static void generate_bishop_attack_map(BoardState *bs, Pos pos, bool out_map[8][8])
+
+// A copy per color, so the side to move is only branched on once per call
+static FORCE_INLINE void generate_legal_body(BoardState *bs, Color color, MoveGenType type, MoveList *out_moves)
 {
-    assert(bs != NULL);
-    assert(out_map != NULL);
-    assert(is_bishop(get_piece(bs, pos)));
+    if (color == C_WHITE)
+    {
+        generate_legal_color(bs, C_WHITE, type, out_moves);
+    }
+    else
+    {
+        generate_legal_color(bs, C_BLACK, type, out_moves);
+    }
+}
 
-    generate_slide_attack_map(bs, pos, 1, 1, out_map);
-    generate_slide_attack_map(bs, pos, -1, -1, out_map);
-    generate_slide_attack_map(bs, pos, 1, -1, out_map);
-    generate_slide_attack_map(bs, pos, -1, 1, out_map);
+CPU_DEFINE_ISA_KERNELS_VOID(generate_legal, (BoardState * bs, Color color, MoveGenType type, MoveList *out_moves),
+                            (bs, color, type, out_moves))
+
+static void generate_legal(BoardState *bs, Color color, MoveGenType type, MoveList *out_moves)
+{
+    CPU_DISPATCH_ISA_VOID(generate_legal, (bs, color, type, out_moves));
 }
 
-static void generate_step_attack_map(Pos target_pos, bool out_map[8][8])
+// Castling also checks the squares the king goes through, as the generator does
+static bool is_castle_pseudo_legal(BoardState *bs, Move move, Color color)
 {
+    Square from = move_from(move);
+    Square to = move_to(move);
+    bool king_side = move_get_castle(move) == CASTLE_KINGSIDE;
+    Square king_start = color == C_WHITE ? 60 : 4;
 
-    assert(out_map != NULL);
+    if (from != king_start || to != (king_side ? from + 2 : from - 2) || !has_castle_right(bs, color, king_side) ||
+        piece_on(bs, king_side ? from + 3 : from - 4) != create_piece(PT_ROOK, color))
+    {
+        return false;
+    }
 
-    if (target_pos.x >= 0 && target_pos.x <= 7 && target_pos.y >= 0 && target_pos.y <= 7)
+    Bitboard between = king_side ? square_bb(from + 1) | square_bb(from + 2)
+                                 : square_bb(from - 1) | square_bb(from - 2) | square_bb(from - 3);
+    if (get_occupied_bitboard(bs) & between)
     {
-        out_map[target_pos.x][target_pos.y] = true;
+        return false;
     }
+
+    Color enemy = color == C_WHITE ? C_BLACK : C_WHITE;
+    int8_t step = king_side ? 1 : -1;
+    return !is_square_attacked(bs, from, enemy) && !is_square_attacked(bs, from + step, enemy) &&
+           !is_square_attacked(bs, from + 2 * step, enemy);
 }
-static void generate_king_attack_map(Pos pos, bool out_map[8][8])
+
+static bool is_pawn_move_pseudo_legal(BoardState *bs, Move move, Color color)
 {
-    assert(out_map != NULL);
+    Square from = move_from(move);
+    Square to = move_to(move);
+    Bitboard empty = ~get_occupied_bitboard(bs);
 
-    generate_step_attack_map((Pos){pos.x - 1, pos.y - 1}, out_map);
-    generate_step_attack_map((Pos){pos.x - 1, pos.y}, out_map);
-    generate_step_attack_map((Pos){pos.x - 1, pos.y + 1}, out_map);
+    if (move_get_en_passant(move))
+    {
+        return to == bs->en_passant && (pawn_attacks(color, from) & square_bb(to)) &&
+               move_get_promotion(move) == PROMOTION_NONE;
+    }
 
-    generate_step_attack_map((Pos){pos.x, pos.y - 1}, out_map);
-    generate_step_attack_map((Pos){pos.x, pos.y + 1}, out_map);
+    // Reaching the last rank always promotes, and only there
+    int8_t ending_y = color == C_WHITE ? 0 : 7;
+    if ((square_to_pos(to).y == ending_y) != (move_get_promotion(move) != PROMOTION_NONE))
+    {
+        return false;
+    }
+
+    if (pawn_attacks(color, from) & square_bb(to))
+    {
+        return (get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE) & square_bb(to)) != BB_EMPTY;
+    }
 
-    generate_step_attack_map((Pos){pos.x + 1, pos.y - 1}, out_map);
-    generate_step_attack_map((Pos){pos.x + 1, pos.y}, out_map);
-    generate_step_attack_map((Pos){pos.x + 1, pos.y + 1}, out_map);
+    int8_t forward = color == C_WHITE ? -8 : 8;
+    int8_t starting_y = color == C_WHITE ? 6 : 1;
+    if (to == from + forward)
+    {
+        return (empty & square_bb(to)) != BB_EMPTY;
+    }
+    if (to == from + 2 * forward && square_to_pos(from).y == starting_y)
+    {
+        return (empty & square_bb(from + forward)) && (empty & square_bb(to));
+    }
+
+    return false;
 }
-static void generate_knight_attack_map(Pos pos, bool out_map[8][8])
+
+bool is_move_pseudo_legal(BoardState *bs, Move move)
 {
-    assert(out_map != NULL);
+    assert(bs != NULL);
 
-    generate_step_attack_map((Pos){pos.x - 2, pos.y - 1}, out_map);
-    generate_step_attack_map((Pos){pos.x - 2, pos.y + 1}, out_map);
+    if (move == MOVE_NONE)
+    {
+        return false;
+    }
 
-    generate_step_attack_map((Pos){pos.x + 2, pos.y - 1}, out_map);
-    generate_step_attack_map((Pos){pos.x + 2, pos.y + 1}, out_map);
+    Color color = bs->turn;
+    Square from = move_from(move);
+    Square to = move_to(move);
+    Piece piece = piece_on(bs, from);
 
-    generate_step_attack_map((Pos){pos.x + 1, pos.y - 2}, out_map);
-    generate_step_attack_map((Pos){pos.x - 1, pos.y - 2}, out_map);
+    // Flag values past the last promotion are never created
+    if (move_get_promotion(move) > PROMOTION_KNIGHT)
+    {
+        return false;
+    }
 
-    generate_step_attack_map((Pos){pos.x + 1, pos.y + 2}, out_map);
-    generate_step_attack_map((Pos){pos.x - 1, pos.y + 2}, out_map);
-}
-static void generate_pawn_attack_map(BoardState *bs, Pos pos, bool out_map[8][8])
-{
-    assert(bs != NULL);
-    assert(out_map != NULL);
-    assert(is_pawn(get_piece(bs, pos)));
+    if (is_empty(piece) || get_color(piece) != color || (get_color_bitboard(bs, color) & square_bb(to)))
+    {
+        return false;
+    }
 
-    int8_t direction = get_color(get_piece(bs, pos)) == C_WHITE ? -1 : 1;
+    if (move_get_castle(move) != CASTLE_NONE)
+    {
+        return get_type(piece) == PT_KING && is_castle_pseudo_legal(bs, move, color);
+    }
 
-    generate_step_attack_map((Pos){pos.x - 1, pos.y + direction}, out_map);
-    generate_step_attack_map((Pos){pos.x + 1, pos.y + direction}, out_map);
-}
+    if (get_type(piece) == PT_PAWN)
+    {
+        return is_pawn_move_pseudo_legal(bs, move, color);
+    }
 
-#if 0
-static void generate_piece_attack_map(BoardState *bs, Pos pos, bool out_map[8][8])
-{
-    assert(bs != NULL);
-    assert(out_map != NULL);
+    if (move_get_en_passant(move) || move_get_promotion(move) != PROMOTION_NONE)
+    {
+        return false;
+    }
 
-    Piece piece = get_piece(bs, pos);
+    Bitboard occupied = get_occupied_bitboard(bs);
+    Bitboard attacks;
     switch (get_type(piece))
     {
-    case PT_PAWN: {
-        generate_pawn_attack_map(bs, pos, out_map);
+    case PT_KNIGHT:
+        attacks = knight_attacks(from);
         break;
-    }
-    case PT_KNIGHT: {
-        generate_knight_attack_map(pos, out_map);
+    case PT_BISHOP:
+        attacks = bishop_attacks(from, occupied);
         break;
-    }
-    case PT_BISHOP: {
-        generate_bishop_attack_map(bs, pos, out_map);
+    case PT_ROOK:
+        attacks = rook_attacks(from, occupied);
         break;
-    }
-    case PT_ROOK: {
-        generate_rook_attack_map(bs, pos, out_map);
+    case PT_QUEEN:
+        attacks = queen_attacks(from, occupied);
         break;
-    }
-    case PT_QUEEN: {
-        generate_queen_attack_map(bs, pos, out_map);
+    case PT_KING:
+    default:
+        attacks = king_attacks(from);
         break;
     }
-    case PT_KING: {
-        generate_king_attack_map(pos, out_map);
-        break;
+
+    return (attacks & square_bb(to)) != BB_EMPTY;
+}
+
+bool is_move_legal(BoardState *bs, Move move)
+{
+    assert(bs != NULL);
+
+    if (!is_move_pseudo_legal(bs, move))
+    {
+        return false;
+    }
+
+    Color color = bs->turn;
+    Bitboard king = get_pieces_bitboard(bs, PT_KING, color);
+    // No king, every move is legal. Castling was checked with the pseudo legality
+    if (king == BB_EMPTY || move_get_castle(move) != CASTLE_NONE)
+    {
+        return true;
+    }
+
+    Square king_sq = lsb(king);
+    Square from = move_from(move);
+    Square to = move_to(move);
+    Bitboard enemies = get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+
+    if (move_get_en_passant(move))
+    {
+        return is_en_passant_legal(bs, king_sq, from, to, color);
+    }
+
+    if (from == king_sq)
+    {
+        Bitboard occupied_without_king = get_occupied_bitboard(bs) ^ square_bb(king_sq);
+        return (attackers_to(bs, to, occupied_without_king) & enemies) == BB_EMPTY;
     }
+
+    // Same masks as the generator: capture or block a single checker, and stay on the pin line
+    Bitboard checkers = attackers_to(bs, king_sq, get_occupied_bitboard(bs)) & enemies;
+    if (checkers != BB_EMPTY)
+    {
+        if ((checkers & (checkers - 1)) != BB_EMPTY ||
+            ((checkers | between_bb(king_sq, lsb(checkers))) & square_bb(to)) == BB_EMPTY)
+        {
+            return false;
+        }
     }
+
+    return !(pinned_pieces(bs, king_sq, color) & square_bb(from)) || (line_bb(king_sq, from) & square_bb(to));
 }
-#endif
 
-void generate_attack_map(BoardState *bs, Color color, bool out_map[8][8])
+void check_info_init(BoardState *bs, CheckInfo *out_ci)
 {
     assert(bs != NULL);
-    assert(out_map != NULL);
+    assert(out_ci != NULL);
+
+    Color us = bs->turn;
+    Color enemy = us == C_WHITE ? C_BLACK : C_WHITE;
+    Bitboard king = get_pieces_bitboard(bs, PT_KING, enemy);
+
+    memset(out_ci, 0, sizeof(*out_ci));
+    out_ci->enemy_king = SQUARE_NONE;
+    // No king, nothing can give check
+    if (king == BB_EMPTY)
+    {
+        return;
+    }
 
-    memset(out_map, 0, sizeof(bool) * 8 * 8);
+    Square king_sq = lsb(king);
+    Bitboard occupied = get_occupied_bitboard(bs);
+    out_ci->enemy_king = king_sq;
 
-    int8_t index;
-    int8_t *len;
+    // A piece checks from the squares the same kind of piece on the king's square attacks
+    out_ci->check_squares[PT_PAWN - 1] = pawn_attacks(enemy, king_sq);
+    out_ci->check_squares[PT_KNIGHT - 1] = knight_attacks(king_sq);
+    out_ci->check_squares[PT_BISHOP - 1] = bishop_attacks(king_sq, occupied);
+    out_ci->check_squares[PT_ROOK - 1] = rook_attacks(king_sq, occupied);
+    out_ci->check_squares[PT_QUEEN - 1] =
+        out_ci->check_squares[PT_BISHOP - 1] | out_ci->check_squares[PT_ROOK - 1];
 
-    pieces_offset(&bs->pieces, PT_PAWN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    out_ci->discovered = slider_blockers(bs, king_sq, us, us);
+}
+
+static FORCE_INLINE bool gives_check_body(BoardState *bs, const CheckInfo *ci, Move move)
+{
+    if (ci->enemy_king == SQUARE_NONE)
     {
-        generate_pawn_attack_map(bs, bs->pieces.list[i], out_map);
+        return false;
     }
 
-    pieces_offset(&bs->pieces, PT_KNIGHT, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    Color us = bs->turn;
+    Square king_sq = ci->enemy_king;
+    Square from = move_from(move);
+    Square to = move_to(move);
+    PieceType pt = get_type(piece_on(bs, from));
+
+    // Direct check
+    if (move_get_promotion(move) == PROMOTION_NONE && (ci->check_squares[pt - 1] & square_bb(to)))
     {
-        generate_knight_attack_map(bs->pieces.list[i], out_map);
+        return true;
     }
 
-    pieces_offset(&bs->pieces, PT_BISHOP, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    // Discovered check, unless the blocker stays on the line
+    if ((ci->discovered & square_bb(from)) && !(line_bb(king_sq, from) & square_bb(to)))
     {
-        generate_bishop_attack_map(bs, bs->pieces.list[i], out_map);
+        return true;
     }
 
-    pieces_offset(&bs->pieces, PT_ROOK, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    Bitboard occupied = get_occupied_bitboard(bs) ^ square_bb(from);
+
+    if (move_get_promotion(move) != PROMOTION_NONE)
     {
-        generate_rook_attack_map(bs, bs->pieces.list[i], out_map);
+        // The promoted piece may attack through the square the pawn left
+        switch (promotion_to_piece_type(move_get_promotion(move)))
+        {
+        case PT_KNIGHT:
+            return (knight_attacks(to) & square_bb(king_sq)) != BB_EMPTY;
+        case PT_BISHOP:
+            return (bishop_attacks(to, occupied) & square_bb(king_sq)) != BB_EMPTY;
+        case PT_ROOK:
+            return (rook_attacks(to, occupied) & square_bb(king_sq)) != BB_EMPTY;
+        case PT_QUEEN:
+        default:
+            return (queen_attacks(to, occupied) & square_bb(king_sq)) != BB_EMPTY;
+        }
     }
 
-    pieces_offset(&bs->pieces, PT_QUEEN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    if (move_get_en_passant(move))
     {
-        generate_queen_attack_map(bs, bs->pieces.list[i], out_map);
+        // Removing the captured pawn can uncover a slider as well
+        Square captured = us == C_WHITE ? to + 8 : to - 8;
+        occupied = (occupied ^ square_bb(captured)) | square_bb(to);
+        Bitboard queens = get_pieces_bitboard(bs, PT_QUEEN, us);
+
+        return (rook_attacks(king_sq, occupied) & (get_pieces_bitboard(bs, PT_ROOK, us) | queens)) ||
+               (bishop_attacks(king_sq, occupied) & (get_pieces_bitboard(bs, PT_BISHOP, us) | queens));
     }
 
-    pieces_offset(&bs->pieces, PT_KING, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    if (move_get_castle(move) != CASTLE_NONE)
     {
-        generate_king_attack_map(bs->pieces.list[i], out_map);
+        // Only the rook can check, from the square the king went over
+        bool king_side = move_get_castle(move) == CASTLE_KINGSIDE;
+        Square rook_from = king_side ? from + 3 : from - 4;
+        Square rook_to = king_side ? from + 1 : from - 1;
+        occupied = (occupied ^ square_bb(rook_from)) | square_bb(to) | square_bb(rook_to);
+
+        return (rook_attacks(rook_to, occupied) & square_bb(king_sq)) != BB_EMPTY;
     }
+
+    return false;
 }
 
-void generate_pawns_attack_map(BoardState *bs, Color color, bool out_pawns_map[8][8])
+CPU_DEFINE_ISA_KERNELS(bool, gives_check, (BoardState * bs, const CheckInfo *ci, Move move), (bs, ci, move))
+
+bool gives_check(BoardState *bs, const CheckInfo *ci, Move move)
 {
     assert(bs != NULL);
-    assert(out_pawns_map != NULL);
+    assert(ci != NULL);
+
+    CPU_DISPATCH_ISA(gives_check, (bs, ci, move));
+}
+
+void generate_legal_moves(BoardState *bs, Color color, MoveList *out_moves)
+{
+    generate_legal(bs, color, GEN_ALL, out_moves);
+}
+
+void generate_noisy_moves(BoardState *bs, Color color, MoveList *out_moves)
+{
+    generate_legal(bs, color, GEN_NOISY, out_moves);
+}
 
-    memset(out_pawns_map, 0, sizeof(bool) * 8 * 8);
+void generate_quiet_moves(BoardState *bs, Color color, MoveList *out_moves)
+{
+    generate_legal(bs, color, GEN_QUIET, out_moves);
+}
+
+void generate_evasions(BoardState *bs, Color color, MoveList *out_moves)
+{
+    assert(bs != NULL);
+    assert(out_moves != NULL);
 
-    int8_t index;
-    int8_t *len;
+    Bitboard king = get_pieces_bitboard(bs, PT_KING, color);
+    assert(king != BB_EMPTY);
+
+    Square king_sq = lsb(king);
+    Bitboard enemies = get_color_bitboard(bs, color == C_WHITE ? C_BLACK : C_WHITE);
+    Bitboard checkers = attackers_to(bs, king_sq, get_occupied_bitboard(bs)) & enemies;
+
+    generate_evasions_type(bs, color, king_sq, checkers, GEN_ALL, out_moves);
+}
+
+// Attack Map generation //
 
-    pieces_offset(&bs->pieces, PT_PAWN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+static FORCE_INLINE Bitboard generate_attack_bitboard_body(BoardState *bs, Color color)
+{
+    Bitboard occupied = get_occupied_bitboard(bs);
+    Bitboard attacks = pawns_attacks(color, get_pieces_bitboard(bs, PT_PAWN, color));
+
+    Bitboard pieces = get_pieces_bitboard(bs, PT_KNIGHT, color);
+    while (pieces != BB_EMPTY)
+    {
+        attacks |= knight_attacks(pop_lsb(&pieces));
+    }
+
+    pieces = get_pieces_bitboard(bs, PT_BISHOP, color) | get_pieces_bitboard(bs, PT_QUEEN, color);
+    while (pieces != BB_EMPTY)
+    {
+        attacks |= bishop_attacks(pop_lsb(&pieces), occupied);
+    }
+
+    pieces = get_pieces_bitboard(bs, PT_ROOK, color) | get_pieces_bitboard(bs, PT_QUEEN, color);
+    while (pieces != BB_EMPTY)
+    {
+        attacks |= rook_attacks(pop_lsb(&pieces), occupied);
+    }
+
+    pieces = get_pieces_bitboard(bs, PT_KING, color);
+    while (pieces != BB_EMPTY)
+    {
+        attacks |= king_attacks(pop_lsb(&pieces));
+    }
+
+    return attacks;
+}
+
+CPU_DEFINE_ISA_KERNELS(Bitboard, generate_attack_bitboard, (BoardState * bs, Color color), (bs, color))
+
+Bitboard generate_attack_bitboard(BoardState *bs, Color color)
+{
+    assert(bs != NULL);
+
+    CPU_DISPATCH_ISA(generate_attack_bitboard, (bs, color));
+}
+
+Bitboard generate_pawns_attack_bitboard(BoardState *bs, Color color)
+{
+    assert(bs != NULL);
+
+    return pawns_attacks(color, get_pieces_bitboard(bs, PT_PAWN, color));
+}
+
+static void bitboard_to_map(Bitboard bb, bool out_map[8][8])
+{
+    assert(out_map != NULL);
+
+    for (Square sq = 0; sq < 64; sq++)
     {
-        generate_pawn_attack_map(bs, bs->pieces.list[i], out_pawns_map);
+        Pos pos = square_to_pos(sq);
+        out_map[pos.x][pos.y] = (bb & square_bb(sq)) != BB_EMPTY;
     }
 }
+
+void generate_attack_map(BoardState *bs, Color color, bool out_map[8][8])
+{
+    assert(bs != NULL);
+    assert(out_map != NULL);
+
+    bitboard_to_map(generate_attack_bitboard(bs, color), out_map);
+}
+
+void generate_pawns_attack_map(BoardState *bs, Color color, bool out_pawns_map[8][8])
+{
+    assert(bs != NULL);
+    assert(out_pawns_map != NULL);
+
+    bitboard_to_map(generate_pawns_attack_bitboard(bs, color), out_pawns_map);
+}
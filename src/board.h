@@ -1,6 +1,6 @@
 #pragma once
 
-#include "array.h"
+#include "bitboard.h"
 #include "common.h"
 #include "move.h"
 #include "piece.h"
@@ -9,66 +9,131 @@
 extern "C" {
 #endif
 
-typedef struct PiecesListLengths
-{
-    int8_t pawn_len;
-    int8_t knight_len;
-    int8_t bishop_len;
-    int8_t rook_len;
-    int8_t queen_len;
-    int8_t king_len;
-} PiecesListLengths;
-
-typedef struct PiecesList
-{
-    Pos list[64];
-    PiecesListLengths white;
-    PiecesListLengths black;
-} PiecesList;
-
-void pieces_offset(PiecesList *pl, PieceType pt, Color c, int8_t *out_index, int8_t **out_len);
-void pieces_all_color_offset(PiecesList *pl, Color c, int8_t *out_index, int8_t *out_len);
-
-#define NO_EN_PASSANT (-9)
+// Castling rights, packed in the low nibble of BoardState.castle_rights
+#define CASTLE_RIGHT_WHITE_KING_SIDE 1
+#define CASTLE_RIGHT_WHITE_QUEEN_SIDE 2
+#define CASTLE_RIGHT_BLACK_KING_SIDE 4
+#define CASTLE_RIGHT_BLACK_QUEEN_SIDE 8
+#define CASTLE_RIGHTS_ALL 15
 
+// Bitboards are the only copy of the pieces
 typedef struct BoardState
 {
     uint64_t zobrist_hash;
-    Piece board[8][8];
-    PiecesList pieces;
-    Color turn;
-    bool white_king_side_castle;
-    bool white_queen_side_castle;
-    bool black_king_side_castle;
-    bool black_queen_side_castle;
-    int8_t en_passant_x; // NO_EN_PASSANT if no en passant
-    int8_t en_passant_y; // NO_EN_PASSANT if no en passant
-    int halfmove_clock;
-    int fullmove_number;
+    uint64_t pawn_key;        // pawns only
+    uint64_t material_key;    // number of pieces of each kind, wherever they stand
+    uint64_t non_pawn_key[2]; // [color], pieces other than pawns, -1 is substracted from color
+    Bitboard pieces_bb[6]; // [piece type], -1 is substracted from piece type
+    Bitboard color_bb[2];  // [color], -1 is substracted from color
+    uint16_t fullmove_number;
+    uint8_t halfmove_clock; // stops at 255
+    Square en_passant;      // SQUARE_NONE if no en passant
+    uint8_t castle_rights;  // CASTLE_RIGHT_* flags
+    uint8_t turn;           // Color
+    uint8_t reserved[2];    // explicit tail padding, the state must fit in two cache lines (checked in board.c)
 } BoardState;
 
+// fen must be valid, see parse_fen to read untrusted input
 BoardState load_fen(const char *fen);
+// Recomputes every key from the pieces, castling rights, en passant and turn
+void board_refresh_keys(BoardState *bs);
 void print_board(BoardState *bs);
 void print_attack_map(bool out_map[8][8]);
 
 void set_piece(BoardState *bs, Pos pos, Piece p);
 Piece get_piece(BoardState *bs, Pos pos);
+Piece piece_on(BoardState *bs, Square sq);
+bool has_castle_right(BoardState *bs, Color c, bool king_side);
 void update_castle_right(BoardState *bs, Color c, bool king_side, bool value);
 
+Bitboard get_pieces_bitboard(BoardState *bs, PieceType pt, Color c);
+Bitboard get_color_bitboard(BoardState *bs, Color c);
+Bitboard get_occupied_bitboard(BoardState *bs);
+
+// State make_move can't recompute when unmaking a move
+typedef struct MoveUndo
+{
+    uint64_t zobrist_hash;
+    uint64_t pawn_key;
+    uint64_t material_key;
+    uint64_t non_pawn_key[2];
+    uint8_t halfmove_clock;
+    Square en_passant;
+    uint8_t castle_rights;
+    Piece captured;      // empty for en passant, the captured pawn is not on the target square
+    uint8_t reserved[4]; // explicit tail padding
+} MoveUndo;
+
 void make_move(BoardState *bs, Move move);
+void make_move_undo(BoardState *bs, Move move, MoveUndo *out_undo);
+// Undoes make_move_undo, move and undo must be the ones it was called with
+void unmake_move(BoardState *bs, Move move, MoveUndo *undo);
+
+// Pieces of both colors attacking sq, with sliders blocked by occupied
+Bitboard attackers_to(BoardState *bs, Square sq, Bitboard occupied);
+
+// attackers_to without the dispatch, for the bodies of other per ISA kernels so it is compiled with them
+static FORCE_INLINE Bitboard attackers_to_body(BoardState *bs, Square sq, Bitboard occupied)
+{
+    Bitboard queens = bs->pieces_bb[PT_QUEEN - 1];
 
+    return (pawn_attacks(C_BLACK, sq) & bs->pieces_bb[PT_PAWN - 1] & bs->color_bb[C_WHITE - 1]) |
+           (pawn_attacks(C_WHITE, sq) & bs->pieces_bb[PT_PAWN - 1] & bs->color_bb[C_BLACK - 1]) |
+           (knight_attacks(sq) & bs->pieces_bb[PT_KNIGHT - 1]) | (king_attacks(sq) & bs->pieces_bb[PT_KING - 1]) |
+           (bishop_attacks(sq, occupied) & (bs->pieces_bb[PT_BISHOP - 1] | queens)) |
+           (rook_attacks(sq, occupied) & (bs->pieces_bb[PT_ROOK - 1] | queens));
+}
+
+bool is_square_attacked(BoardState *bs, Square sq, Color by_color);
 bool is_in_check(BoardState *bs, Color color);
 
-void generate_pseudo_moves(BoardState *bs, Color color, Array(Move) * out_moves);
-void generate_piece_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_pawn_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_king_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_queen_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_rook_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_bishop_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
-void generate_knight_pseudo_moves(BoardState *bs, Pos pos, Array(Move) * out_moves);
+void generate_pseudo_moves(BoardState *bs, Color color, MoveList *out_moves);
+void generate_piece_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_pawn_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_king_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_queen_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_rook_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_bishop_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+void generate_knight_pseudo_moves(BoardState *bs, Pos pos, MoveList *out_moves);
+
+// Captures, en passant and promotions
+bool move_is_noisy(BoardState *bs, Move move);
+
+typedef enum MoveGenType
+{
+    GEN_ALL,
+    GEN_NOISY, // captures, en passant and promotions
+    GEN_QUIET, // every other move, castles included
+} MoveGenType;
+
+// Whether move, e.g. from the transposition table, could have been generated for the side to move. Castles are
+// checked fully, other moves may still leave the king in check
+bool is_move_pseudo_legal(BoardState *bs, Move move);
+// Whether move is one of the legal moves of the side to move, any Move value is accepted
+bool is_move_legal(BoardState *bs, Move move);
+
+// Only legal moves, using check and pin masks instead of trying each move
+void generate_legal_moves(BoardState *bs, Color color, MoveList *out_moves);
+void generate_noisy_moves(BoardState *bs, Color color, MoveList *out_moves);
+void generate_quiet_moves(BoardState *bs, Color color, MoveList *out_moves);
+// Only when color is in check: king steps, and with a single checker, its capture or a block on its ray
+void generate_evasions(BoardState *bs, Color color, MoveList *out_moves);
+
+// What the side to move needs to know to tell which of its moves give check, without making them
+typedef struct CheckInfo
+{
+    Bitboard check_squares[6]; // [type - 1], squares from which such a piece attacks the enemy king
+    Bitboard discovered;       // own pieces whose move can uncover a check by an own slider
+    Square enemy_king;         // SQUARE_NONE if there is none
+    uint8_t reserved[7];       // explicit tail padding
+} CheckInfo;
+
+void check_info_init(BoardState *bs, CheckInfo *out_ci);
+// move must be legal, ci must come from check_info_init in the same position
+bool gives_check(BoardState *bs, const CheckInfo *ci, Move move);
 
-void generate_legal_moves(BoardState *bs, Color color, Array(Move) * out_moves);
+Bitboard generate_attack_bitboard(BoardState *bs, Color color);
+Bitboard generate_pawns_attack_bitboard(BoardState *bs, Color color);
 
 void generate_attack_map(BoardState *bs, Color color, bool out_map[8][8]);
 void generate_pawns_attack_map(BoardState *bs, Color color, bool out_pawns_map[8][8]);
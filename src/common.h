@@ -9,6 +9,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+// For bodies taking a constant color, so each per-color copy has its color checks folded away
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
 #ifdef USE_MIMALLOC
 #include <mimalloc.h>
 
@@ -0,0 +1,164 @@
+#include "cpu.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef CPU_X86_64
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t out[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int *)out, (int)leaf, (int)subleaf);
+#else
+    __cpuid_count(leaf, subleaf, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+// Register state enabled by the OS, a CPU feature is unusable if its registers are not saved on context switches
+static uint64_t xgetbv(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static CpuFeatures detect_features(void)
+{
+    CpuFeatures features = {0};
+
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+
+    char vendor[13] = {0};
+    memcpy(vendor + 0, &regs[1], 4); // ebx
+    memcpy(vendor + 4, &regs[3], 4); // edx
+    memcpy(vendor + 8, &regs[2], 4); // ecx
+
+    if (max_leaf < 7)
+    {
+        return features;
+    }
+
+    cpuid(1, 0, regs);
+    uint32_t family = (regs[0] >> 8) & 0xF;
+    if (family == 0xF)
+    {
+        family += (regs[0] >> 20) & 0xFF;
+    }
+    bool fma = (regs[2] >> 12) & 1;     // ecx bit 12
+    bool osxsave = (regs[2] >> 27) & 1; // ecx bit 27
+    bool avx = (regs[2] >> 28) & 1;     // ecx bit 28
+
+    uint64_t xcr0 = osxsave ? xgetbv() : 0;
+    bool ymm_saved = (xcr0 & 0x6) == 0x6;   // sse and avx state
+    bool zmm_saved = (xcr0 & 0xE6) == 0xE6; // and opmask, upper zmm0-15 and zmm16-31
+
+    cpuid(0x80000000, 0, regs);
+    bool lzcnt = false;
+    if (regs[0] >= 0x80000001)
+    {
+        cpuid(0x80000001, 0, regs);
+        lzcnt = (regs[2] >> 5) & 1; // ecx bit 5
+    }
+
+    cpuid(7, 0, regs);
+    bool bmi1 = (regs[1] >> 3) & 1;     // ebx bit 3
+    bool avx2 = (regs[1] >> 5) & 1;     // ebx bit 5
+    features.bmi2 = (regs[1] >> 8) & 1; // ebx bit 8
+
+    // ebx bits 16, 17, 30 and 31: AVX-512 F, DQ, BW and VL
+    uint32_t avx512_bits = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+
+    features.avx2 = avx && avx2 && ymm_saved && fma && lzcnt && bmi1 && features.bmi2;
+    features.avx512 = features.avx2 && zmm_saved && (regs[1] & avx512_bits) == avx512_bits;
+
+    // Zen 1 and 2 (family 17h, and Hygon) implement PEXT in microcode, slower than a magic multiplication
+    bool amd = strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0;
+    features.fast_pext = features.bmi2 && (!amd || family >= 0x19);
+
+    return features;
+}
+#else
+static CpuFeatures detect_features(void)
+{
+    return (CpuFeatures){0};
+}
+#endif
+
+CpuFeatures cpu_features(void)
+{
+    static bool detected = false;
+    static CpuFeatures features;
+
+    if (!detected)
+    {
+        features = detect_features();
+        detected = true;
+    }
+
+    return features;
+}
+
+CpuIsa cpu_best_isa(void)
+{
+#ifdef CPU_MULTI_ISA
+    CpuFeatures features = cpu_features();
+    if (features.avx512)
+    {
+        return CPU_ISA_AVX512;
+    }
+    if (features.avx2)
+    {
+        return CPU_ISA_AVX2;
+    }
+#endif
+
+    return CPU_ISA_BASELINE;
+}
+
+static CpuIsa selected_isa = CPU_ISA_BASELINE;
+
+bool cpu_use_isa(CpuIsa isa)
+{
+    if (isa > cpu_best_isa())
+    {
+        return false;
+    }
+
+    selected_isa = isa;
+    return true;
+}
+
+CpuIsa cpu_isa(void)
+{
+    return selected_isa;
+}
+
+const char *cpu_isa_name(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CPU_ISA_BASELINE:
+#ifdef CPU_X86_64
+        return "sse4.2";
+#else
+        return "generic";
+#endif
+    case CPU_ISA_AVX2:
+        return "avx2";
+    case CPU_ISA_AVX512:
+        return "avx512";
+    }
+
+    return "unknown";
+}
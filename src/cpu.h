@@ -0,0 +1,125 @@
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// x86-64 hosts can use the BMI2 kernels when the CPU reports them
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_X86_64
+#endif
+
+// GCC and Clang build the hot kernels once per ISA level, the one used is picked at runtime
+#if defined(CPU_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_MULTI_ISA
+#define CPU_TARGET_AVX2 __attribute__((target("popcnt,sse4.2,avx2,bmi,bmi2,lzcnt,fma")))
+#define CPU_TARGET_AVX512                                                                                              \
+    __attribute__((target("popcnt,sse4.2,avx2,bmi,bmi2,lzcnt,fma,avx512f,avx512bw,avx512dq,avx512vl")))
+#endif
+
+typedef struct CpuFeatures
+{
+    bool bmi2;
+    bool fast_pext; // BMI2 without the microcoded PEXT of AMD CPUs before Zen 3
+    bool avx2;      // with BMI1/2, LZCNT and FMA, and ymm registers saved by the OS
+    bool avx512;    // F, BW, DQ and VL, and zmm registers saved by the OS
+} CpuFeatures;
+
+// Features of the CPU running the program, detected once
+CpuFeatures cpu_features(void);
+
+typedef enum CpuIsa
+{
+    CPU_ISA_BASELINE, // what the whole program is compiled for (SSE4.2 and POPCNT on x86-64)
+    CPU_ISA_AVX2,
+    CPU_ISA_AVX512,
+} CpuIsa;
+
+// Highest ISA level that is both built and supported by this CPU
+CpuIsa cpu_best_isa(void);
+
+// Selects the kernels to run, false if they are not built or the CPU can't run them
+bool cpu_use_isa(CpuIsa isa);
+CpuIsa cpu_isa(void);
+const char *cpu_isa_name(CpuIsa isa);
+
+// Builds name_baseline, name_avx2 and name_avx512 from name_body, an always inlined function, so everything the body
+// inlines is compiled for each ISA level. ret and params are the signature, args forwards the parameters.
+#ifdef CPU_MULTI_ISA
+#define CPU_DEFINE_ISA_KERNELS(ret, name, params, args)                                                                \
+    static ret name##_baseline params                                                                                  \
+    {                                                                                                                  \
+        return name##_body args;                                                                                       \
+    }                                                                                                                  \
+    CPU_TARGET_AVX2 static ret name##_avx2 params                                                                      \
+    {                                                                                                                  \
+        return name##_body args;                                                                                       \
+    }                                                                                                                  \
+    CPU_TARGET_AVX512 static ret name##_avx512 params                                                                  \
+    {                                                                                                                  \
+        return name##_body args;                                                                                       \
+    }
+
+// Returns from the calling function with the result of the selected ISA level build
+#define CPU_DISPATCH_ISA(name, args)                                                                                   \
+    switch (cpu_isa())                                                                                                 \
+    {                                                                                                                  \
+    case CPU_ISA_AVX512:                                                                                               \
+        return name##_avx512 args;                                                                                     \
+    case CPU_ISA_AVX2:                                                                                                 \
+        return name##_avx2 args;                                                                                       \
+    default:                                                                                                           \
+        return name##_baseline args;                                                                                   \
+    }
+
+// The same for a void name_body, ISO C doesn't allow returning a void expression
+#define CPU_DEFINE_ISA_KERNELS_VOID(name, params, args)                                                                \
+    static void name##_baseline params                                                                                 \
+    {                                                                                                                  \
+        name##_body args;                                                                                              \
+    }                                                                                                                  \
+    CPU_TARGET_AVX2 static void name##_avx2 params                                                                     \
+    {                                                                                                                  \
+        name##_body args;                                                                                              \
+    }                                                                                                                  \
+    CPU_TARGET_AVX512 static void name##_avx512 params                                                                 \
+    {                                                                                                                  \
+        name##_body args;                                                                                              \
+    }
+
+#define CPU_DISPATCH_ISA_VOID(name, args)                                                                              \
+    switch (cpu_isa())                                                                                                 \
+    {                                                                                                                  \
+    case CPU_ISA_AVX512:                                                                                               \
+        name##_avx512 args;                                                                                            \
+        return;                                                                                                        \
+    case CPU_ISA_AVX2:                                                                                                 \
+        name##_avx2 args;                                                                                              \
+        return;                                                                                                        \
+    default:                                                                                                           \
+        name##_baseline args;                                                                                          \
+        return;                                                                                                        \
+    }
+#else
+#define CPU_DEFINE_ISA_KERNELS(ret, name, params, args)                                                                \
+    static ret name##_baseline params                                                                                  \
+    {                                                                                                                  \
+        return name##_body args;                                                                                       \
+    }
+
+#define CPU_DISPATCH_ISA(name, args) return name##_baseline args
+
+#define CPU_DEFINE_ISA_KERNELS_VOID(name, params, args)                                                                \
+    static void name##_baseline params                                                                                 \
+    {                                                                                                                  \
+        name##_body args;                                                                                              \
+    }
+
+#define CPU_DISPATCH_ISA_VOID(name, args) name##_baseline args
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,414 @@
+#include "epd.h"
+#include "array.h"
+#include "board.h"
+#include "fen.h"
+#include <SDL.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool is_line_end(char c)
+{
+    return c == '\0' || c == '\r' || c == '\n';
+}
+
+static const char *skip_blanks(const char *s)
+{
+    while (is_blank(*s))
+    {
+        s++;
+    }
+    return s;
+}
+
+// Copies [begin, end) without surrounding quotes, false if it doesn't fit and truncate is false
+static bool copy_operand(const char *begin, const char *end, char *out, size_t out_size, bool truncate)
+{
+    if (end - begin >= 2 && *begin == '"' && end[-1] == '"')
+    {
+        begin++;
+        end--;
+    }
+
+    size_t len = (size_t)(end - begin);
+    if (len >= out_size)
+    {
+        if (!truncate)
+        {
+            return false;
+        }
+        len = out_size - 1;
+    }
+
+    memcpy(out, begin, len);
+    out[len] = '\0';
+    return true;
+}
+
+// The whole operand must be digits
+static bool parse_count(const char *begin, const char *end, uint64_t max, uint64_t *out)
+{
+    if (begin == end)
+    {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (const char *c = begin; c < end; c++)
+    {
+        if (*c < '0' || *c > '9' || value > (max - (uint64_t)(*c - '0')) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + (uint64_t)(*c - '0');
+    }
+
+    *out = value;
+    return true;
+}
+
+static bool parse_operation(const char *opcode, size_t opcode_len, const char *operand, const char *operand_end,
+                            EpdEntry *entry)
+{
+    uint64_t value;
+
+    if (opcode_len == 2 && memcmp(opcode, "id", 2) == 0)
+    {
+        return copy_operand(operand, operand_end, entry->id, sizeof(entry->id), true);
+    }
+    if (opcode_len == 2 && memcmp(opcode, "bm", 2) == 0)
+    {
+        return copy_operand(operand, operand_end, entry->best_moves, sizeof(entry->best_moves), false);
+    }
+    if (opcode_len == 2 && memcmp(opcode, "am", 2) == 0)
+    {
+        return copy_operand(operand, operand_end, entry->avoid_moves, sizeof(entry->avoid_moves), false);
+    }
+    if (opcode_len == 4 && memcmp(opcode, "hmvc", 4) == 0)
+    {
+        if (!parse_count(operand, operand_end, UINT64_MAX, &value))
+        {
+            return false;
+        }
+        // Stops at 255 as in make_move
+        entry->bs.halfmove_clock = (uint8_t)(value < UINT8_MAX ? value : UINT8_MAX);
+        return true;
+    }
+    if (opcode_len == 4 && memcmp(opcode, "fmvn", 4) == 0)
+    {
+        if (!parse_count(operand, operand_end, UINT16_MAX, &value))
+        {
+            return false;
+        }
+        entry->bs.fullmove_number = (uint16_t)value;
+        return true;
+    }
+
+    // Perft node counts, D1 20 ;D2 400 ...
+    uint64_t depth;
+    if (opcode[0] == 'D' && parse_count(opcode + 1, opcode + opcode_len, EPD_MAX_PERFT_DEPTH, &depth) && depth > 0)
+    {
+        if (!parse_count(operand, operand_end, UINT64_MAX, &entry->perft[depth]))
+        {
+            return false;
+        }
+        entry->perft_present |= (uint16_t)(1u << depth);
+        entry->perft_depth = (uint16_t)(depth > entry->perft_depth ? depth : entry->perft_depth);
+        return true;
+    }
+
+    // Unknown operations are skipped
+    return true;
+}
+
+FenError parse_epd(const char *line, EpdEntry *out_entry)
+{
+    assert(line != NULL);
+    assert(out_entry != NULL);
+
+    memset(out_entry, 0, sizeof(*out_entry));
+
+    const char *c;
+    out_entry->error = parse_fen(line, &out_entry->bs, &c);
+    if (out_entry->error != FEN_OK)
+    {
+        return out_entry->error;
+    }
+
+    while (true)
+    {
+        while (is_blank(*c) || *c == ';')
+        {
+            c++;
+        }
+        if (is_line_end(*c))
+        {
+            break;
+        }
+
+        const char *opcode = c;
+        while (!is_blank(*c) && !is_line_end(*c) && *c != ';')
+        {
+            c++;
+        }
+        size_t opcode_len = (size_t)(c - opcode);
+
+        // Operands go up to the ';' or the end of the line (perft suites leave out the last ';'), it can be quoted
+        const char *operand = skip_blanks(c);
+        bool quoted = false;
+        c = operand;
+        while (!is_line_end(*c) && (quoted || *c != ';'))
+        {
+            quoted ^= *c == '"';
+            c++;
+        }
+        if (quoted)
+        {
+            out_entry->error = FEN_ERROR_OPERATION;
+            return out_entry->error;
+        }
+
+        const char *operand_end = c;
+        while (operand_end > operand && is_blank(operand_end[-1]))
+        {
+            operand_end--;
+        }
+
+        if (!parse_operation(opcode, opcode_len, operand, operand_end, out_entry))
+        {
+            out_entry->error = FEN_ERROR_OPERATION;
+            return out_entry->error;
+        }
+    }
+
+    return FEN_OK;
+}
+
+typedef struct MappedFile
+{
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} MappedFile;
+
+static bool map_file(const char *path, MappedFile *out_file)
+{
+    memset(out_file, 0, sizeof(*out_file));
+
+#ifdef _WIN32
+    out_file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out_file->file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(out_file->file, &size))
+    {
+        CloseHandle(out_file->file);
+        return false;
+    }
+    out_file->size = (size_t)size.QuadPart;
+
+    // An empty file can't be mapped, there is nothing to read anyway
+    if (out_file->size > 0)
+    {
+        out_file->mapping = CreateFileMappingA(out_file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        out_file->data = out_file->mapping != NULL ? MapViewOfFile(out_file->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (out_file->data == NULL)
+        {
+            if (out_file->mapping != NULL)
+            {
+                CloseHandle(out_file->mapping);
+            }
+            CloseHandle(out_file->file);
+            return false;
+        }
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    out_file->size = (size_t)st.st_size;
+
+    // An empty file can't be mapped, there is nothing to read anyway
+    if (out_file->size > 0)
+    {
+        void *data = mmap(NULL, out_file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        out_file->data = data;
+    }
+    close(fd);
+#endif
+
+    return true;
+}
+
+static void unmap_file(MappedFile *file)
+{
+#ifdef _WIN32
+    if (file->data != NULL)
+    {
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+    }
+    CloseHandle(file->file);
+#else
+    if (file->data != NULL)
+    {
+        munmap((void *)file->data, file->size);
+    }
+#endif
+}
+
+typedef struct EpdLine
+{
+    const char *begin;
+    size_t len;
+    size_t number;
+} EpdLine;
+
+typedef struct EpdThreadData
+{
+    SDL_Thread *thread;
+    const EpdLine *lines;
+    EpdEntry *entries;
+    size_t begin;
+    size_t end;
+} EpdThreadData;
+
+static int epd_thread(void *args)
+{
+    EpdThreadData *data = (EpdThreadData *)args;
+
+    for (size_t i = data->begin; i < data->end; i++)
+    {
+        const EpdLine *line = &data->lines[i];
+        EpdEntry *entry = &data->entries[i];
+
+        // The mapping isn't terminated, each line is copied on the stack
+        char buffer[EPD_MAX_LINE_LENGTH];
+        if (line->len >= sizeof(buffer))
+        {
+            memset(entry, 0, sizeof(*entry));
+            entry->error = FEN_ERROR_TOO_LONG;
+        }
+        else
+        {
+            memcpy(buffer, line->begin, line->len);
+            buffer[line->len] = '\0';
+            parse_epd(buffer, entry);
+        }
+        entry->line = line->number;
+    }
+
+    return 0;
+}
+
+bool epd_read_file(const char *path, int threads, Array(EpdEntry) * out_entries)
+{
+    assert(path != NULL);
+    assert(out_entries != NULL);
+
+    MappedFile file;
+    if (!map_file(path, &file))
+    {
+        return false;
+    }
+
+    // Non blank lines
+    Array(EpdLine) lines = array_create(EpdLine);
+    const char *c = file.data;
+    const char *end = file.data + file.size;
+    for (size_t number = 1; c < end; number++)
+    {
+        const char *newline = memchr(c, '\n', (size_t)(end - c));
+        const char *line_end = newline != NULL ? newline : end;
+
+        for (const char *s = c; s < line_end; s++)
+        {
+            if (!is_blank(*s) && *s != '\r')
+            {
+                array_push(lines, ((EpdLine){.begin = c, .len = (size_t)(line_end - c), .number = number}));
+                break;
+            }
+        }
+
+        c = line_end < end ? line_end + 1 : end;
+    }
+
+    size_t count = array_len(lines);
+    Array(EpdEntry) entries = array_create_size(EpdEntry, count);
+    array_len(entries) = count;
+
+    if (threads <= 0)
+    {
+        threads = SDL_GetCPUCount();
+    }
+    if ((size_t)threads > count)
+    {
+        threads = count > 0 ? (int)count : 1;
+    }
+
+    // Contiguous slices, the calling thread takes the first one
+    EpdThreadData *threads_data = malloc(sizeof(EpdThreadData) * (size_t)threads);
+    assert(threads_data != NULL);
+    for (int i = 0; i < threads; i++)
+    {
+        threads_data[i] = (EpdThreadData){
+            .thread = NULL,
+            .lines = lines,
+            .entries = entries,
+            .begin = count * (size_t)i / (size_t)threads,
+            .end = count * (size_t)(i + 1) / (size_t)threads,
+        };
+        if (i > 0)
+        {
+            threads_data[i].thread = SDL_CreateThread(epd_thread, "epd_thread", &threads_data[i]);
+            assert(threads_data[i].thread != NULL);
+        }
+    }
+
+    epd_thread(&threads_data[0]);
+    for (int i = 1; i < threads; i++)
+    {
+        SDL_WaitThread(threads_data[i].thread, NULL);
+    }
+
+    free(threads_data);
+    array_free(lines);
+    unmap_file(&file);
+
+    *out_entries = entries;
+    return true;
+}
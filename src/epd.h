@@ -0,0 +1,42 @@
+#pragma once
+
+#include "array.h"
+#include "board.h"
+#include "common.h"
+#include "fen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EPD_MAX_PERFT_DEPTH 15
+#define EPD_ID_LENGTH 64
+#define EPD_MOVES_LENGTH 64
+// Longer lines are rejected with FEN_ERROR_TOO_LONG
+#define EPD_MAX_LINE_LENGTH 1024
+
+// One EPD line, the position and the operations we know about
+typedef struct EpdEntry
+{
+    BoardState bs;
+    uint64_t perft[EPD_MAX_PERFT_DEPTH + 1]; // [depth], node counts of the D1, D2... operations
+    size_t line;                             // 1 based, in the file it was read from
+    char id[EPD_ID_LENGTH];                  // id operation without quotes, truncated
+    char best_moves[EPD_MOVES_LENGTH];       // bm operation, SAN moves separated by spaces
+    char avoid_moves[EPD_MOVES_LENGTH];      // am operation, SAN moves separated by spaces
+    FenError error;                          // FEN_OK, or why the line was rejected
+    uint16_t perft_present;                  // bit depth is set if the D<depth> operation was given (even with 0 nodes)
+    uint16_t perft_depth;                    // deepest D operation, 0 if none, 16 bits so the entry has no tail padding
+} EpdEntry;
+
+// Parses one line: a position, optionally followed by FEN clocks, then operations separated by ';'.
+// hmvc and fmvn set the clocks, unknown operations are skipped. Nothing is allocated
+FenError parse_epd(const char *line, EpdEntry *out_entry);
+
+// Maps the file and parses its non blank lines on threads (0 for one per CPU). Invalid lines are kept with their
+// error set. False if the file can't be read, otherwise *out_entries must be freed with array_free
+bool epd_read_file(const char *path, int threads, Array(EpdEntry) * out_entries);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,13 @@
 #include "evaluation.h"
 #include "array.h"
+#include "bitboard.h"
 #include "board.h"
 #include "cache.h"
+#include "cpu.h"
 #include "move.h"
+#include "move_picker.h"
 #include "piece.h"
+#include "see.h"
 #include <assert.h>
 #include <float.h>
 #include <limits.h>
@@ -43,79 +47,39 @@ double king_table[64] = {-30, -40, -40, -50, -50, -40, -40, -30, -30, -40, -40,
                          -20, -30, -30, -40, -40, -30, -30, -20, -10, -20, -20, -20, -20, -20, -20, -10,
                          20,  20,  0,   0,   0,   0,   20,  20,  20,  30,  10,  0,   0,   10,  30,  20};
 
-static double pieces_square_table(BoardState *bs, Color color)
+static double *piece_square_tables[] = {NULL,       pawn_table,  knight_table, bishop_table,
+                                        rook_table, queen_table, king_table};
+
+static FORCE_INLINE double pieces_square_table(BoardState *bs, Color color)
 {
     assert(bs != NULL);
 
     double score = 0;
 
-    int y_offset = color == C_WHITE ? 0 : 7; // reverse the table for black
-
-    int8_t index;
-    int8_t *len;
-    pieces_offset(&bs->pieces, PT_PAWN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += pawn_table[x + (y * 8)];
-    }
-
-    pieces_offset(&bs->pieces, PT_KNIGHT, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += knight_table[x + (y * 8)];
-    }
-
-    pieces_offset(&bs->pieces, PT_BISHOP, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += bishop_table[x + (y * 8)];
-    }
+    Square flip = color == C_WHITE ? 0 : 56; // reverse the table for black
 
-    pieces_offset(&bs->pieces, PT_ROOK, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
+    for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
     {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += rook_table[x + (y * 8)];
-    }
-
-    pieces_offset(&bs->pieces, PT_QUEEN, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += queen_table[x + (y * 8)];
-    }
-
-    pieces_offset(&bs->pieces, PT_KING, color, &index, &len);
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        int x = bs->pieces.list[i].x;
-        int y = abs(y_offset - bs->pieces.list[i].y);
-        score += king_table[x + (y * 8)];
+        Bitboard pieces = get_pieces_bitboard(bs, pt, color);
+        while (pieces != BB_EMPTY)
+        {
+            score += piece_square_tables[pt][pop_lsb(&pieces) ^ flip];
+        }
     }
 
     return score;
 }
 
-static int count_doubled_and_isolated_pawns(BoardState *bs, Color c)
+static FORCE_INLINE int count_doubled_and_isolated_pawns(BoardState *bs, Color c)
 {
     assert(bs != NULL);
 
-    int8_t index;
-    int8_t *len;
-    pieces_offset(&bs->pieces, PT_PAWN, c, &index, &len);
+    Bitboard pawns = get_pieces_bitboard(bs, PT_PAWN, c);
 
     int pawns_on_file[8] = {0};
-    for (int8_t i = index; i < index + *len; i++)
+    for (int8_t x = 0; x < 8; x++)
     {
-        pawns_on_file[bs->pieces.list[i].x]++;
+        pawns_on_file[x] = popcount(pawns & BB_FILE(x));
     }
 
     int doubled_pawns = 0;
@@ -128,9 +92,9 @@ static int count_doubled_and_isolated_pawns(BoardState *bs, Color c)
     }
 
     int isolated_pawns = 0;
-    for (int8_t i = index; i < index + *len; i++)
+    while (pawns != BB_EMPTY)
     {
-        Pos pos = bs->pieces.list[i];
+        Pos pos = square_to_pos(pop_lsb(&pawns));
 
         bool left = pos.x == 0 || pawns_on_file[pos.x - 1] == 0;
         bool right = pos.x == 7 || pawns_on_file[pos.x + 1] == 0;
@@ -142,50 +106,25 @@ static int count_doubled_and_isolated_pawns(BoardState *bs, Color c)
 
     return doubled_pawns + isolated_pawns;
 }
-static int count_blocked_pawns(BoardState *bs, Color c)
+static FORCE_INLINE int count_blocked_pawns(BoardState *bs, Color c)
 {
     assert(bs != NULL);
 
-    int direction = c == C_WHITE ? -1 : 1;
-
-    int8_t index;
-    int8_t *len;
-    pieces_offset(&bs->pieces, PT_PAWN, c, &index, &len);
+    Bitboard pawns = get_pieces_bitboard(bs, PT_PAWN, c);
+    Bitboard forward = c == C_WHITE ? pawns >> 8 : pawns << 8;
 
-    int blocked_pawns = 0;
-    for (int8_t i = index; i < index + *len; i++)
-    {
-        Pos pos = bs->pieces.list[i];
-        Pos forward = (Pos){pos.x, pos.y + direction};
-        if (!is_empty(get_piece(bs, forward)))
-        {
-            blocked_pawns++;
-        }
-    }
-
-    return blocked_pawns;
+    return popcount(forward & get_occupied_bitboard(bs));
 }
-uint64_t count = 0;
-double evaluate(BoardState *bs)
+static FORCE_INLINE double evaluate_body(BoardState *bs)
 {
-    count++;
-    assert(bs != NULL);
-
     double score = 0;
 
     // material
-    score += bs->pieces.white.king_len * piece_value[PT_KING];
-    score += bs->pieces.black.king_len * -piece_value[PT_KING];
-    score += bs->pieces.white.queen_len * piece_value[PT_QUEEN];
-    score += bs->pieces.black.queen_len * -piece_value[PT_QUEEN];
-    score += bs->pieces.white.rook_len * piece_value[PT_ROOK];
-    score += bs->pieces.black.rook_len * -piece_value[PT_ROOK];
-    score += bs->pieces.white.bishop_len * piece_value[PT_BISHOP];
-    score += bs->pieces.black.bishop_len * -piece_value[PT_BISHOP];
-    score += bs->pieces.white.knight_len * piece_value[PT_KNIGHT];
-    score += bs->pieces.black.knight_len * -piece_value[PT_KNIGHT];
-    score += bs->pieces.white.pawn_len * piece_value[PT_PAWN];
-    score += bs->pieces.black.pawn_len * -piece_value[PT_PAWN];
+    for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+    {
+        score += popcount(get_pieces_bitboard(bs, pt, C_WHITE)) * piece_value[pt];
+        score += popcount(get_pieces_bitboard(bs, pt, C_BLACK)) * -piece_value[pt];
+    }
 
     // pawn structure
     score += ((double)count_doubled_and_isolated_pawns(bs, C_WHITE)) * -50;
@@ -200,70 +139,15 @@ double evaluate(BoardState *bs)
     return score;
 }
 
-static double evaluate_move(BoardState *bs, Move *move, Move *cache_move, bool pawns_attack_map[8][8])
-{
-    assert(bs != NULL);
-    assert(move != NULL);
-
-    double score = 0;
-    Piece move_piece = get_piece(bs, move->from);
-    Piece capture_piece = get_piece(bs, move->to);
-
-    if (!is_empty(capture_piece))
-    {
-        score += 10 * piece_value[get_type(capture_piece)] - piece_value[get_type(move_piece)];
-    }
-
-    switch (move_get_promotion(move))
-    {
-    case PROMOTION_NONE:
-        break;
-    case PROMOTION_QUEEN:
-        score += piece_value[PT_QUEEN];
-        break;
-    case PROMOTION_ROOK:
-        score += piece_value[PT_ROOK];
-        break;
-    case PROMOTION_BISHOP:
-        score += piece_value[PT_BISHOP];
-        break;
-    case PROMOTION_KNIGHT:
-        score += piece_value[PT_KNIGHT];
-        break;
-    }
-
-    // Penalize moving into a pawn attack
-    if (pawns_attack_map[move->to.x][move->to.y])
-    {
-        score -= piece_value[get_type(move_piece)];
-    }
-
-    if (cache_move != NULL && move_equals(*move, *cache_move))
-    {
-        score += 1000;
-    }
-
-    return score;
-}
-
-#define SORT_NAME move
-#define SORT_TYPE Move
-#define SORT_CMP(x, y) ((y).order_move_score - (x).order_move_score)
-#include <sort.h>
+CPU_DEFINE_ISA_KERNELS(double, evaluate, (BoardState * bs), (bs))
 
-static void order_moves(BoardState *bs, Array(Move) moves, Move *cache_move)
+uint64_t count = 0;
+double evaluate(BoardState *bs)
 {
+    count++;
     assert(bs != NULL);
-    assert(moves != NULL);
 
-    bool pawns_attack_map[8][8];
-    generate_pawns_attack_map(bs, bs->turn == C_WHITE ? C_BLACK : C_WHITE, pawns_attack_map); // get color from moves ?
-
-    for (size_t i = 0; i < array_len(moves); i++)
-    {
-        moves[i].order_move_score = evaluate_move(bs, &moves[i], cache_move, pawns_attack_map);
-    }
-    move_tim_sort(moves, array_len(moves));
+    CPU_DISPATCH_ISA(evaluate, (bs));
 }
 
 #ifndef MAX
@@ -306,6 +190,9 @@ static double correct_score_set(double score, int ply_from_root)
 static bool cache_init = false;
 static Cache cache;
 
+#define MAX_PLY 128
+static Move killer_moves[MAX_PLY][2]; // [ply from root]
+
 static double negamax_captures(SDL_atomic_t *abort_search, BoardState *bs, double alpha, double beta)
 {
     // Handle abort
@@ -321,41 +208,31 @@ static double negamax_captures(SDL_atomic_t *abort_search, BoardState *bs, doubl
     }
     alpha = MAX(alpha, score);
 
-    Array(Move) all_moves = array_create_size(Move, 32);
-    generate_pseudo_moves(bs, bs->turn, &all_moves);
-
-    // Filter out non captures
-    Array(Move) moves = array_create_size(Move, array_len(all_moves));
-    for (size_t i = 0; i < array_len(all_moves); i++)
-    {
-        if (!is_empty(get_piece(bs, all_moves[i].to)))
-        {
-            array_push(moves, all_moves[i]);
-        }
-    }
-    array_free(all_moves);
-
-    Move *cache_move = NULL;
+    Move cache_move = MOVE_NONE;
     CacheEntry *cache_entry = cache_get(&cache, bs->zobrist_hash);
     if (cache_entry != NULL)
     {
-        cache_move = &cache_entry->move;
+        cache_move = cache_entry->move;
     }
 
-    order_moves(bs, moves, cache_move);
+    // Only captures and promotions
+    MovePicker mp;
+    move_picker_init_qsearch(&mp, bs, cache_move);
 
-    for (size_t i = 0; i < array_len(moves); i++)
+    Move move;
+    while (move_picker_next(&mp, &move))
     {
-        BoardState new_bs = *bs;
-        make_move(&new_bs, moves[i]);
-
-        // Check if move was legal
-        if (is_in_check(&new_bs, bs->turn))
+        // Losing captures are very unlikely to raise alpha
+        if (!see_ge(bs, move, 0))
         {
             continue;
         }
 
-        score = -negamax_captures(abort_search, &new_bs, -beta, -alpha);
+        MoveUndo undo;
+        make_move_undo(bs, move, &undo);
+        score = -negamax_captures(abort_search, bs, -beta, -alpha);
+        unmake_move(bs, move, &undo);
+
         alpha = MAX(alpha, score);
         if (alpha >= beta)
         {
@@ -363,8 +240,6 @@ static double negamax_captures(SDL_atomic_t *abort_search, BoardState *bs, doubl
         }
     }
 
-    array_free(moves);
-
     return alpha;
 }
 
@@ -391,13 +266,14 @@ static double negamax(SDL_atomic_t *abort_search, BoardState *bs, Array(uint64_t
         }
     }
 
-    Move *cache_move = NULL;
+    Move cache_move = MOVE_NONE;
     CacheEntry *cache_entry = cache_get(&cache, bs->zobrist_hash);
     if (cache_entry != NULL)
     {
-        cache_move = &cache_entry->move;
+        cache_move = cache_entry->move;
 
-        if (cache_entry->depth >= depth)
+        // The root returns the stored move, it must be playable here and not come from a colliding position
+        if (cache_entry->depth >= depth && (out_move == NULL || is_move_legal(bs, cache_entry->move)))
         {
             double cache_value = correct_score_get(cache_entry->value, ply_from_root);
 
@@ -429,7 +305,7 @@ static double negamax(SDL_atomic_t *abort_search, BoardState *bs, Array(uint64_t
         }
     }
 
-    Move best_move = {0};
+    Move best_move = MOVE_NONE;
     double value = -INFINITY;
     if (depth == 0)
     {
@@ -437,41 +313,42 @@ static double negamax(SDL_atomic_t *abort_search, BoardState *bs, Array(uint64_t
     }
     else
     {
-        Array(Move) moves = array_create_size(Move, 32);
-        generate_pseudo_moves(bs, bs->turn, &moves);
-        order_moves(bs, moves, cache_move);
+        Move *killers = ply_from_root < MAX_PLY ? killer_moves[ply_from_root] : NULL;
+        MovePicker mp;
+        move_picker_init(&mp, bs, cache_move, killers);
 
         array_push(*seen_positions, bs->zobrist_hash); // Add current position for repetition checks
         bool had_legal_move = false;
-        for (size_t i = 0; i < array_len(moves); i++)
+        Move move;
+        while (move_picker_next(&mp, &move))
         {
-            BoardState new_bs = *bs;
-            make_move(&new_bs, moves[i]);
-
-            //  Check if move was legal
-            if (is_in_check(&new_bs, bs->turn))
-            {
-                continue;
-            }
             had_legal_move = true;
 
+            MoveUndo undo;
+            make_move_undo(bs, move, &undo);
             double score =
-                -negamax(abort_search, &new_bs, seen_positions, ply_from_root + 1, depth - 1, -beta, -alpha, NULL);
+                -negamax(abort_search, bs, seen_positions, ply_from_root + 1, depth - 1, -beta, -alpha, NULL);
+            unmake_move(bs, move, &undo);
+
             if (score > value)
             {
                 value = score;
-                best_move = moves[i];
+                best_move = move;
             }
             alpha = MAX(alpha, value);
             if (alpha >= beta)
             {
+                // Quiet moves refuting a sibling are likely to refute this one too
+                if (killers != NULL && !move_is_noisy(bs, move) && killers[0] != move)
+                {
+                    killers[1] = killers[0];
+                    killers[0] = move;
+                }
                 break;
             }
         }
         (void)array_pop(*seen_positions);
 
-        array_free(moves);
-
         // Checkmate and stalemate detection
         if (!had_legal_move)
         {
@@ -542,8 +419,9 @@ Move search_move(BoardState *bs, Array(uint64_t) * seen_positions, int depth)
         cache = cache_create();
         cache_init = true;
     }
+    memset(killer_moves, 0, sizeof(killer_moves));
 
-    Move best_move = {0};
+    Move best_move = MOVE_NONE;
     for (int i = 1; i <= depth; i++)
     {
         count = 0;
@@ -563,15 +441,16 @@ Move search_move_abortable(SDL_atomic_t *abort_search, BoardState *bs, Array(uin
         cache = cache_create();
         cache_init = true;
     }
+    memset(killer_moves, 0, sizeof(killer_moves));
 
     // Always search at least at depth 1
-    Move best_move = {0};
+    Move best_move = MOVE_NONE;
     negamax(NULL, bs, seen_positions, 0, 1, -INFINITY, INFINITY, &best_move);
 
     int depth = 2;
     while (true)
     {
-        Move new_move = {0};
+        Move new_move = MOVE_NONE;
 
         count = 0;
         double score = negamax(abort_search, bs, seen_positions, 0, depth, -INFINITY, INFINITY, &new_move);
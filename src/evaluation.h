@@ -1,4 +1,5 @@
 #pragma once
+#include "array.h"
 #include "board.h"
 #include "common.h"
 #include <SDL.h>
@@ -11,6 +12,8 @@ extern "C" {
 #define MATE_VALUE 999999
 #define DRAW_VALUE 0
 
+extern double piece_value[];
+
 bool is_mate_score(double score);
 int ply_to_mate(double score);
 
@@ -0,0 +1,433 @@
+#include "fen.h"
+#include "bitboard.h"
+#include "board.h"
+#include "piece.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static const char piece_chars[] = " PNBRQK"; // [piece type]
+
+const char *fen_error_string(FenError error)
+{
+    switch (error)
+    {
+    case FEN_OK:
+        return "ok";
+    case FEN_ERROR_BOARD:
+        return "invalid piece placement";
+    case FEN_ERROR_TURN:
+        return "invalid active color";
+    case FEN_ERROR_CASTLING:
+        return "invalid castling rights";
+    case FEN_ERROR_EN_PASSANT:
+        return "invalid en passant square";
+    case FEN_ERROR_CLOCKS:
+        return "invalid halfmove clock or fullmove number";
+    case FEN_ERROR_KINGS:
+        return "each side needs exactly one king";
+    case FEN_ERROR_PAWNS:
+        return "pawn on the first or last rank";
+    case FEN_ERROR_MATERIAL:
+        return "too many pieces for one side";
+    case FEN_ERROR_CHECK:
+        return "the side not to move is in check";
+    case FEN_ERROR_OPERATION:
+        return "invalid EPD operation";
+    case FEN_ERROR_TOO_LONG:
+        return "line too long";
+    }
+
+    return "unknown error";
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Fields are separated by blanks, what follows the last one is up to the caller
+static bool is_field_end(char c)
+{
+    return is_blank(c) || c == '\0' || c == '\r' || c == '\n' || c == ';';
+}
+
+static const char *skip_blanks(const char *s)
+{
+    while (is_blank(*s))
+    {
+        s++;
+    }
+    return s;
+}
+
+static Piece char_to_piece(char c)
+{
+    Color color = c >= 'a' ? C_BLACK : C_WHITE;
+    char upper = c >= 'a' ? (char)(c - 'a' + 'A') : c;
+
+    for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+    {
+        if (piece_chars[pt] == upper)
+        {
+            return create_piece(pt, color);
+        }
+    }
+
+    return piece_empty();
+}
+
+// A whole field of digits, false if it is empty or above max
+static bool parse_number(const char **s, uint32_t max, uint32_t *out)
+{
+    const char *c = *s;
+    uint32_t value = 0;
+
+    if (*c < '0' || *c > '9')
+    {
+        return false;
+    }
+    while (*c >= '0' && *c <= '9')
+    {
+        uint32_t digit = (uint32_t)(*c++ - '0');
+        if (value > (max - digit) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    if (!is_field_end(*c))
+    {
+        return false;
+    }
+
+    *s = c;
+    *out = value;
+    return true;
+}
+
+static const char *parse_placement(const char *fen, BoardState *bs)
+{
+    int x = 0;
+    int y = 0;
+    bool previous_digit = false;
+
+    while (!is_field_end(*fen))
+    {
+        char c = *fen++;
+        Piece p = char_to_piece(c);
+
+        if (c >= '1' && c <= '8' && !previous_digit)
+        {
+            x += c - '0';
+            previous_digit = true;
+        }
+        else if (c == '/' && x == 8 && y < 7)
+        {
+            x = 0;
+            y++;
+            previous_digit = false;
+        }
+        else if (!is_empty(p) && x < 8)
+        {
+            Bitboard bb = square_bb(pos_to_square((Pos){(int8_t)x, (int8_t)y}));
+            bs->pieces_bb[get_type(p) - 1] |= bb;
+            bs->color_bb[get_color(p) - 1] |= bb;
+            x++;
+            previous_digit = false;
+        }
+        else
+        {
+            return NULL;
+        }
+
+        if (x > 8)
+        {
+            return NULL;
+        }
+    }
+
+    return x == 8 && y == 7 ? fen : NULL;
+}
+
+static const char *parse_castling(const char *fen, BoardState *bs)
+{
+    if (*fen == '-')
+    {
+        return is_field_end(fen[1]) ? fen + 1 : NULL;
+    }
+
+    while (!is_field_end(*fen))
+    {
+        uint8_t right;
+        switch (*fen++)
+        {
+        case 'K':
+            right = CASTLE_RIGHT_WHITE_KING_SIDE;
+            break;
+        case 'Q':
+            right = CASTLE_RIGHT_WHITE_QUEEN_SIDE;
+            break;
+        case 'k':
+            right = CASTLE_RIGHT_BLACK_KING_SIDE;
+            break;
+        case 'q':
+            right = CASTLE_RIGHT_BLACK_QUEEN_SIDE;
+            break;
+        default:
+            return NULL;
+        }
+
+        if (bs->castle_rights & right)
+        {
+            return NULL;
+        }
+        bs->castle_rights |= right;
+    }
+
+    return bs->castle_rights != 0 ? fen : NULL;
+}
+
+// Each right needs the king and the rook on their starting squares, make_move relies on it
+static bool are_castle_rights_valid(BoardState *bs)
+{
+    static const struct
+    {
+        uint8_t right;
+        uint8_t color; // Color, a byte so the entries aren't padded
+        Square king;
+        Square rook;
+    } castles[] = {
+        {CASTLE_RIGHT_WHITE_KING_SIDE, C_WHITE, 60, 63},
+        {CASTLE_RIGHT_WHITE_QUEEN_SIDE, C_WHITE, 60, 56},
+        {CASTLE_RIGHT_BLACK_KING_SIDE, C_BLACK, 4, 7},
+        {CASTLE_RIGHT_BLACK_QUEEN_SIDE, C_BLACK, 4, 0},
+    };
+
+    for (size_t i = 0; i < sizeof(castles) / sizeof(castles[0]); i++)
+    {
+        if ((bs->castle_rights & castles[i].right) &&
+            (piece_on(bs, castles[i].king) != create_piece(PT_KING, (Color)castles[i].color) ||
+             piece_on(bs, castles[i].rook) != create_piece(PT_ROOK, (Color)castles[i].color)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int promoted_count(BoardState *bs, PieceType pt, Color c, int initial)
+{
+    int count = popcount(get_pieces_bitboard(bs, pt, c));
+    return count > initial ? count - initial : 0;
+}
+
+// At most 8 pawns and 16 pieces, each piece above the initial set is a promoted pawn. The material key counts up to
+// 15 pieces of a kind, which this keeps every count below.
+static bool is_material_valid(BoardState *bs, Color c)
+{
+    int pawns = popcount(get_pieces_bitboard(bs, PT_PAWN, c));
+    int promoted = promoted_count(bs, PT_KNIGHT, c, 2) + promoted_count(bs, PT_BISHOP, c, 2) +
+                   promoted_count(bs, PT_ROOK, c, 2) + promoted_count(bs, PT_QUEEN, c, 1);
+
+    return pawns <= 8 && popcount(get_color_bitboard(bs, c)) <= 16 && promoted <= 8 - pawns;
+}
+
+static const char *parse_en_passant(const char *fen, BoardState *bs)
+{
+    if (*fen == '-')
+    {
+        return is_field_end(fen[1]) ? fen + 1 : NULL;
+    }
+
+    // The square behind a pawn of the side not to move, that just made a double step
+    int8_t y = bs->turn == C_WHITE ? 2 : 5;
+    if (fen[0] < 'a' || fen[0] > 'h' || fen[1] != '1' + 7 - y || !is_field_end(fen[2]))
+    {
+        return NULL;
+    }
+
+    Square sq = pos_to_square((Pos){(int8_t)(fen[0] - 'a'), y});
+    Square pawn = bs->turn == C_WHITE ? sq + 8 : sq - 8;
+    Square start = bs->turn == C_WHITE ? sq - 8 : sq + 8;
+    Color enemy = bs->turn == C_WHITE ? C_BLACK : C_WHITE;
+    Bitboard occupied = get_occupied_bitboard(bs);
+
+    if (piece_on(bs, pawn) != create_piece(PT_PAWN, enemy) || (occupied & (square_bb(sq) | square_bb(start))))
+    {
+        return NULL;
+    }
+
+    bs->en_passant = sq;
+    return fen + 2;
+}
+
+FenError parse_fen(const char *fen, BoardState *out_bs, const char **out_end)
+{
+    assert(fen != NULL);
+    assert(out_bs != NULL);
+
+    BoardState bs = {0};
+    bs.en_passant = SQUARE_NONE;
+    bs.fullmove_number = 1;
+
+    fen = parse_placement(skip_blanks(fen), &bs);
+    if (fen == NULL)
+    {
+        return FEN_ERROR_BOARD;
+    }
+
+    fen = skip_blanks(fen);
+    if ((*fen != 'w' && *fen != 'b') || !is_field_end(fen[1]))
+    {
+        return FEN_ERROR_TURN;
+    }
+    bs.turn = *fen++ == 'w' ? C_WHITE : C_BLACK;
+
+    fen = parse_castling(skip_blanks(fen), &bs);
+    if (fen == NULL)
+    {
+        return FEN_ERROR_CASTLING;
+    }
+
+    fen = parse_en_passant(skip_blanks(fen), &bs);
+    if (fen == NULL)
+    {
+        return FEN_ERROR_EN_PASSANT;
+    }
+
+    // Optional clocks, both or none
+    const char *clocks = skip_blanks(fen);
+    if (*clocks >= '0' && *clocks <= '9')
+    {
+        uint32_t halfmove_clock;
+        uint32_t fullmove_number;
+        if (!parse_number(&clocks, UINT32_MAX, &halfmove_clock))
+        {
+            return FEN_ERROR_CLOCKS;
+        }
+        clocks = skip_blanks(clocks);
+        if (!parse_number(&clocks, UINT16_MAX, &fullmove_number))
+        {
+            return FEN_ERROR_CLOCKS;
+        }
+
+        // Stops at 255 as in make_move, real games can go past it
+        bs.halfmove_clock = (uint8_t)(halfmove_clock < UINT8_MAX ? halfmove_clock : UINT8_MAX);
+        bs.fullmove_number = (uint16_t)fullmove_number;
+        fen = clocks;
+    }
+
+    if (popcount(get_pieces_bitboard(&bs, PT_KING, C_WHITE)) != 1 ||
+        popcount(get_pieces_bitboard(&bs, PT_KING, C_BLACK)) != 1)
+    {
+        return FEN_ERROR_KINGS;
+    }
+    if (bs.pieces_bb[PT_PAWN - 1] & (BB_RANK_1 | BB_RANK_8))
+    {
+        return FEN_ERROR_PAWNS;
+    }
+    if (!is_material_valid(&bs, C_WHITE) || !is_material_valid(&bs, C_BLACK))
+    {
+        return FEN_ERROR_MATERIAL;
+    }
+    if (!are_castle_rights_valid(&bs))
+    {
+        return FEN_ERROR_CASTLING;
+    }
+    if (is_in_check(&bs, bs.turn == C_WHITE ? C_BLACK : C_WHITE))
+    {
+        return FEN_ERROR_CHECK;
+    }
+
+    board_refresh_keys(&bs);
+
+    *out_bs = bs;
+    if (out_end != NULL)
+    {
+        *out_end = fen;
+    }
+    return FEN_OK;
+}
+
+size_t board_to_fen(BoardState *bs, char buffer[FEN_MAX_LENGTH])
+{
+    assert(bs != NULL);
+    assert(buffer != NULL);
+
+    char *out = buffer;
+
+    for (int8_t y = 0; y < 8; y++)
+    {
+        int empty = 0;
+        for (int8_t x = 0; x < 8; x++)
+        {
+            Piece p = piece_on(bs, pos_to_square((Pos){x, y}));
+            if (is_empty(p))
+            {
+                empty++;
+                continue;
+            }
+
+            if (empty > 0)
+            {
+                *out++ = (char)('0' + empty);
+                empty = 0;
+            }
+            char c = piece_chars[get_type(p)];
+            *out++ = get_color(p) == C_BLACK ? (char)(c - 'A' + 'a') : c;
+        }
+
+        if (empty > 0)
+        {
+            *out++ = (char)('0' + empty);
+        }
+        if (y < 7)
+        {
+            *out++ = '/';
+        }
+    }
+
+    *out++ = ' ';
+    *out++ = bs->turn == C_WHITE ? 'w' : 'b';
+    *out++ = ' ';
+
+    if (bs->castle_rights == 0)
+    {
+        *out++ = '-';
+    }
+    if (bs->castle_rights & CASTLE_RIGHT_WHITE_KING_SIDE)
+    {
+        *out++ = 'K';
+    }
+    if (bs->castle_rights & CASTLE_RIGHT_WHITE_QUEEN_SIDE)
+    {
+        *out++ = 'Q';
+    }
+    if (bs->castle_rights & CASTLE_RIGHT_BLACK_KING_SIDE)
+    {
+        *out++ = 'k';
+    }
+    if (bs->castle_rights & CASTLE_RIGHT_BLACK_QUEEN_SIDE)
+    {
+        *out++ = 'q';
+    }
+    *out++ = ' ';
+
+    if (bs->en_passant == SQUARE_NONE)
+    {
+        *out++ = '-';
+    }
+    else
+    {
+        pos_to_string(square_to_pos(bs->en_passant), out);
+        out += 2;
+    }
+
+    int len = snprintf(out, FEN_MAX_LENGTH - (size_t)(out - buffer), " %u %u", (unsigned)bs->halfmove_clock,
+                       (unsigned)bs->fullmove_number);
+    assert(len > 0);
+
+    return (size_t)(out - buffer) + (size_t)len;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "board.h"
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest FEN board_to_fen writes, terminator included
+#define FEN_MAX_LENGTH 92
+
+typedef enum FenError
+{
+    FEN_OK,
+    FEN_ERROR_BOARD,      // piece placement field
+    FEN_ERROR_TURN,       // active color field
+    FEN_ERROR_CASTLING,   // castling field, or a right without its king and rook in place
+    FEN_ERROR_EN_PASSANT, // en passant field, or no pawn that just made a double step
+    FEN_ERROR_CLOCKS,     // halfmove clock and fullmove number
+    FEN_ERROR_KINGS,      // not exactly one king per side
+    FEN_ERROR_PAWNS,      // pawn on the first or last rank
+    FEN_ERROR_MATERIAL,   // more pieces of a side than its pawns could have promoted to
+    FEN_ERROR_CHECK,      // the side not to move is in check
+    FEN_ERROR_OPERATION,  // EPD operation
+    FEN_ERROR_TOO_LONG,   // EPD line
+} FenError;
+
+const char *fen_error_string(FenError error);
+
+// Parses and validates a FEN, or the 4 fields of an EPD position. The clocks are optional, 0 and 1 if missing.
+// Nothing is allocated, out_bs is only written on success and the keys are computed once at the end.
+// out_end (can be NULL) is set after the last field read, fen can go on (e.g. EPD operations or UCI moves)
+FenError parse_fen(const char *fen, BoardState *out_bs, const char **out_end);
+
+// Returns the length written, without the terminator
+size_t board_to_fen(BoardState *bs, char buffer[FEN_MAX_LENGTH]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+// Writes the zobrist keys as a C source file, run at build time so the keys are constant data
+#include "zobrist_table.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Changing the seed changes every hash, and invalidates anything keyed by them
+#define ZOBRIST_SEED 0x4368657373ULL
+
+// SplitMix64, well distributed 64 bit outputs from a plain counter
+static uint64_t next_rand(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void print_keys(FILE *f, const uint64_t *keys, size_t len, const char *indent)
+{
+    fprintf(f, "%s{", indent);
+    for (size_t i = 0; i < len; i++)
+    {
+        fprintf(f, "%s0x%016" PRIX64 "ULL", i > 0 ? ", " : "", keys[i]);
+    }
+    fprintf(f, "}");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <output.c>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Filled in declaration order, so the keys only depend on the seed and the table layout
+    ZobristTable table;
+    uint64_t state = ZOBRIST_SEED;
+    uint64_t *keys = (uint64_t *)&table;
+    for (size_t i = 0; i < sizeof(table) / sizeof(uint64_t); i++)
+    {
+        keys[i] = next_rand(&state);
+    }
+
+    FILE *f = fopen(argv[1], "w");
+    if (f == NULL)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(f, "// Generated by gen_zobrist, do not edit\n#include \"zobrist_table.h\"\n\n");
+    fprintf(f, "const ZobristTable zobrist_table = {\n    {\n");
+    for (int c = 0; c < 2; c++)
+    {
+        fprintf(f, "        {\n");
+        for (int pt = 0; pt < 6; pt++)
+        {
+            fprintf(f, "            {\n");
+            for (int x = 0; x < 8; x++)
+            {
+                print_keys(f, table.pieces[c][pt][x], 8, "                ");
+                fprintf(f, ",\n");
+            }
+            fprintf(f, "            },\n");
+        }
+        fprintf(f, "        },\n");
+    }
+    fprintf(f, "    },\n    {\n");
+    for (int c = 0; c < 2; c++)
+    {
+        fprintf(f, "        {\n");
+        for (int pt = 0; pt < 6; pt++)
+        {
+            print_keys(f, table.material[c][pt], 16, "            ");
+            fprintf(f, ",\n");
+        }
+        fprintf(f, "        },\n");
+    }
+    fprintf(f, "    },\n    {\n");
+    for (int c = 0; c < 2; c++)
+    {
+        print_keys(f, table.castling[c], 2, "        ");
+        fprintf(f, ",\n");
+    }
+    fprintf(f, "    },\n    0x%016" PRIX64 "ULL,\n", table.black_turn);
+    print_keys(f, table.en_passant_file, 8, "    ");
+    fprintf(f, ",\n};\n");
+
+    if (fclose(f) != 0)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,12 +1,13 @@
 #include "array.h"
+#include "bitboard.h"
 #include "board.h"
 #include "evaluation.h"
 #include "move.h"
 #include "perft.h"
 #include "piece.h"
-#include "zobrist.h"
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -77,6 +78,13 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream)
     return pos;
 }
 
+static void print_perft_usage(void)
+{
+    fprintf(stderr, "usage: chess [depth] [threads] [split depth] [hash MB]\n"
+                    "depth >= 0, threads -1 for a single threaded count or 0 for one per core, split depth >= 1, "
+                    "hash MB >= 0 (0 for none)\n");
+}
+
 void main_perft(int argc, char *argv[])
 {
 
@@ -92,22 +100,49 @@ void main_perft(int argc, char *argv[])
         depth = atoi(argv[1]);
     }
 
-    bool threads = false;
+    // Number of threads, 0 for one per core
+    int threads = -1;
     if (argc > 2)
     {
-        threads = true;
+        threads = atoi(argv[2]);
+    }
+
+    int split_depth = PERFT_DEFAULT_SPLIT_DEPTH;
+    if (argc > 3)
+    {
+        split_depth = atoi(argv[3]);
     }
 
+    // Table size in MB, 0 for none
+    int hash_mb = 0;
+    if (argc > 4)
+    {
+        hash_mb = atoi(argv[4]);
+    }
+
+    if (depth < 0 || threads < -1 || split_depth < 1 || hash_mb < 0)
+    {
+        print_perft_usage();
+        return;
+    }
+    PerftTable table = perft_table_create((size_t)hash_mb);
+
     BoardState bs = load_fen(fen);
 
-    if (threads)
+    if (threads >= 0)
     {
-        printf("%llu\n", perft_thread_sched(&bs, depth));
+        printf("%" PRIu64 "\n", perft_parallel(&bs, depth, threads, split_depth, &table));
+    }
+    else if (table.buckets != NULL)
+    {
+        printf("%" PRIu64 "\n", perft_hashed(&bs, depth, &table));
     }
     else
     {
         printf("%zu\n", perft(bs, depth));
     }
+
+    perft_table_free(&table);
 }
 
 void main_search(int argc, char *argv[])
@@ -170,7 +205,7 @@ void main_divide(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
-    zobrist_init();
+    bitboard_init();
 
     (void)argc;
     (void)argv;
@@ -0,0 +1,309 @@
+#include "array.h"
+#include "bitboard.h"
+#include "board.h"
+#include "common.h"
+#include "cpu.h"
+#include "epd.h"
+#include "fen.h"
+#include "perft.h"
+#include <SDL.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Deepest D operation counted by default, deeper ones take minutes per position
+#define SUITE_DEFAULT_MAX_DEPTH 6
+
+typedef struct SuiteResult
+{
+    uint64_t nodes;       // count of the deepest depth
+    uint64_t total_nodes; // sum over every counted depth
+    uint64_t expected;    // count of the first wrong depth
+    uint64_t got;
+    double seconds; // of the deepest depth
+    int depth;       // deepest counted depth, 0 if none
+    int wrong_depth; // 0 if every count matched
+} SuiteResult;
+
+typedef struct SuiteContext
+{
+    const EpdEntry *entries;
+    SuiteResult *results;
+    size_t count;
+    int max_depth;
+    SDL_atomic_t next; // next entry to take
+} SuiteContext;
+
+static void run_entry(const EpdEntry *entry, int max_depth, SuiteResult *out_result)
+{
+    memset(out_result, 0, sizeof(*out_result));
+    if (entry->error != FEN_OK)
+    {
+        return;
+    }
+
+    int last_depth = entry->perft_depth < max_depth ? entry->perft_depth : max_depth;
+    for (int depth = 1; depth <= last_depth; depth++)
+    {
+        // Suites can leave out some depths, a count of 0 is still checked
+        if ((entry->perft_present & (1u << depth)) == 0)
+        {
+            continue;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        uint64_t nodes = perft(entry->bs, depth);
+        out_result->seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+        out_result->nodes = nodes;
+        out_result->total_nodes += nodes;
+        out_result->depth = depth;
+        if (nodes != entry->perft[depth] && out_result->wrong_depth == 0)
+        {
+            out_result->wrong_depth = depth;
+            out_result->expected = entry->perft[depth];
+            out_result->got = nodes;
+        }
+    }
+}
+
+// Positions are taken one at a time, their costs differ by orders of magnitude
+static int suite_thread(void *args)
+{
+    SuiteContext *ctx = (SuiteContext *)args;
+
+    while (true)
+    {
+        size_t i = (size_t)SDL_AtomicAdd(&ctx->next, 1);
+        if (i >= ctx->count)
+        {
+            break;
+        }
+        run_entry(&ctx->entries[i], ctx->max_depth, &ctx->results[i]);
+    }
+
+    return 0;
+}
+
+static double nodes_per_second(uint64_t nodes, double seconds)
+{
+    return seconds > 0 ? (double)nodes / seconds : 0;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            printf("\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            printf("\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void print_text(const EpdEntry *entries, const SuiteResult *results, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const EpdEntry *entry = &entries[i];
+        const SuiteResult *result = &results[i];
+        if (entry->error != FEN_OK)
+        {
+            printf("line %zu: invalid, %s\n", entry->line, fen_error_string(entry->error));
+            continue;
+        }
+
+        BoardState bs = entry->bs;
+        char fen[FEN_MAX_LENGTH];
+        board_to_fen(&bs, fen);
+        printf("line %zu: %s D%d %" PRIu64 " nodes %.3f s %.0f nps", entry->line, entry->id[0] != '\0' ? entry->id : fen,
+               result->depth, result->nodes, result->seconds, nodes_per_second(result->nodes, result->seconds));
+        if (result->wrong_depth != 0)
+        {
+            printf(" FAILED D%d expected %" PRIu64 " got %" PRIu64, result->wrong_depth, result->expected, result->got);
+        }
+        printf("\n");
+    }
+}
+
+static void print_json(const EpdEntry *entries, const SuiteResult *results, size_t count)
+{
+    printf("  \"positions\": [");
+    for (size_t i = 0; i < count; i++)
+    {
+        const EpdEntry *entry = &entries[i];
+        const SuiteResult *result = &results[i];
+        printf(i == 0 ? "\n" : ",\n");
+
+        printf("    {\"line\": %zu, ", entry->line);
+        if (entry->error != FEN_OK)
+        {
+            printf("\"error\": ");
+            print_json_string(fen_error_string(entry->error));
+            printf("}");
+            continue;
+        }
+
+        BoardState bs = entry->bs;
+        char fen[FEN_MAX_LENGTH];
+        board_to_fen(&bs, fen);
+        printf("\"fen\": ");
+        print_json_string(fen);
+        printf(", \"id\": ");
+        print_json_string(entry->id);
+        printf(", \"depth\": %d, \"nodes\": %" PRIu64 ", \"seconds\": %.6f, \"nps\": %.0f, \"total_nodes\": %" PRIu64
+               ", \"ok\": %s",
+               result->depth, result->nodes, result->seconds, nodes_per_second(result->nodes, result->seconds),
+               result->total_nodes, result->wrong_depth == 0 ? "true" : "false");
+        if (result->wrong_depth != 0)
+        {
+            printf(", \"wrong_depth\": %d, \"expected\": %" PRIu64 ", \"got\": %" PRIu64, result->wrong_depth,
+                   result->expected, result->got);
+        }
+        printf("}");
+    }
+    printf("\n  ],\n");
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr, "usage: chess_perft <suite.epd> [--depth D] [--threads T] [--json]\n"
+                    "Counts the D1..DD operations of every position (D = %d by default) on T threads (0 for one per "
+                    "CPU), exits with 1 if a count is wrong or a line is invalid\n",
+            SUITE_DEFAULT_MAX_DEPTH);
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _WIN32
+    SetConsoleOutputCP(65001); // unicode
+#endif
+
+    const char *path = NULL;
+    int max_depth = SUITE_DEFAULT_MAX_DEPTH;
+    int threads = 0;
+    bool json = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+        {
+            max_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (path == NULL && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 2;
+        }
+    }
+    if (path == NULL || max_depth < 1 || max_depth > EPD_MAX_PERFT_DEPTH || threads < 0)
+    {
+        print_usage();
+        return 2;
+    }
+
+    bitboard_init();
+
+    Array(EpdEntry) entries;
+    if (!epd_read_file(path, 0, &entries))
+    {
+        fprintf(stderr, "can't read %s\n", path);
+        return 2;
+    }
+    size_t count = array_len(entries);
+
+    SuiteContext ctx = {
+        .entries = entries,
+        .results = calloc(count > 0 ? count : 1, sizeof(SuiteResult)),
+        .count = count,
+        .max_depth = max_depth,
+    };
+    assert(ctx.results != NULL);
+    SDL_AtomicSet(&ctx.next, 0);
+
+    if (threads == 0)
+    {
+        threads = SDL_GetCPUCount();
+    }
+    if ((size_t)threads > count)
+    {
+        threads = count > 0 ? (int)count : 1;
+    }
+
+    // The calling thread is one of the workers
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Thread **workers = malloc(sizeof(SDL_Thread *) * (size_t)threads);
+    assert(workers != NULL);
+    for (int i = 1; i < threads; i++)
+    {
+        workers[i] = SDL_CreateThread(suite_thread, "perft_suite", &ctx);
+        assert(workers[i] != NULL);
+    }
+    suite_thread(&ctx);
+    for (int i = 1; i < threads; i++)
+    {
+        SDL_WaitThread(workers[i], NULL);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    free(workers);
+
+    // Every counted depth, over the wall time of the whole run
+    uint64_t total_nodes = 0;
+    size_t failed = 0;
+    size_t invalid = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total_nodes += ctx.results[i].total_nodes;
+        failed += ctx.results[i].wrong_depth != 0;
+        invalid += entries[i].error != FEN_OK;
+    }
+
+    if (json)
+    {
+        printf("{\n  \"kernels\": \"%s\",\n  \"threads\": %d,\n", cpu_isa_name(cpu_isa()), threads);
+        print_json(entries, ctx.results, count);
+        printf("  \"total_nodes\": %" PRIu64 ",\n  \"seconds\": %.6f,\n  \"nps\": %.0f,\n  \"failed\": %zu,\n"
+               "  \"invalid\": %zu\n}\n",
+               total_nodes, seconds, nodes_per_second(total_nodes, seconds), failed, invalid);
+    }
+    else
+    {
+        print_text(entries, ctx.results, count);
+        printf("%zu positions, %" PRIu64 " nodes at every depth in %.3f s, %.0f nps on %d threads (%s kernels)\n",
+               count, total_nodes, seconds, nodes_per_second(total_nodes, seconds), threads, cpu_isa_name(cpu_isa()));
+        printf("%zu failed, %zu invalid\n", failed, invalid);
+    }
+
+    free(ctx.results);
+    array_free(entries);
+
+    return failed == 0 && invalid == 0 ? 0 : 1;
+}
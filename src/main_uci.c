@@ -1,9 +1,11 @@
 #include "array.h"
+#include "bitboard.h"
 #include "board.h"
 #include "common.h"
+#include "cpu.h"
 #include "evaluation.h"
+#include "fen.h"
 #include "move.h"
-#include "zobrist.h"
 #include <SDL.h>
 #include <errno.h>
 #include <pcre2.h>
@@ -82,7 +84,8 @@ bool starts_with(const char *pre, const char *str)
     return lenstr < lenpre ? false : memcmp(pre, str, lenpre) == 0;
 }
 
-BoardState parse_position_command(char *line, Array(uint64_t) * seen_positions)
+// An invalid position keeps the previous one and its history
+BoardState parse_position_command(char *line, BoardState previous, Array(uint64_t) * seen_positions)
 {
     static pcre2_code *position_regex = NULL;
     if (position_regex == NULL)
@@ -116,15 +119,22 @@ BoardState parse_position_command(char *line, Array(uint64_t) * seen_positions)
     }
     else
     {
+        // Parsed in place, the parser stops after the last FEN field
+        int fen_group = pcre2_substring_number_from_name(position_regex, (PCRE2_SPTR) "fen");
+        assert(fen_group > 0);
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
 
-        PCRE2_UCHAR match_buffer[100] = {0};
-        PCRE2_SIZE buffer_size = sizeof(match_buffer);
-        match_res = pcre2_substring_copy_byname(match_data, (PCRE2_SPTR) "fen", match_buffer, &buffer_size);
-        assert(match_res == 0);
-
-        bs = load_fen((char *)match_buffer);
+        FenError error = parse_fen(line + ovector[2 * fen_group], &bs, NULL);
+        if (error != FEN_OK)
+        {
+            printf("info string invalid fen: %s\n", fen_error_string(error));
+            pcre2_match_data_free(match_data);
+            return previous;
+        }
     }
 
+    array_len(*seen_positions) = 0;
+
     if (pcre2_substring_length_byname(match_data, (PCRE2_SPTR) "moves", NULL) == 0)
     {
         PCRE2_UCHAR *moves_buffer = NULL;
@@ -212,6 +222,8 @@ bool handle_command(char *line)
     {
         printf("id name Coco's chess engine\n");
         printf("id author Coco\n");
+        printf("info string kernels %s, slider attacks %s\n", cpu_isa_name(cpu_isa()),
+               slider_attacks_name(bitboard_slider_attacks()));
         printf("uciok\n");
         fflush(stdout);
     }
@@ -230,9 +242,7 @@ bool handle_command(char *line)
     }
     else if (starts_with("position", line))
     {
-        array_free(seen_positions);
-        seen_positions = array_create(uint64_t);
-        bs = parse_position_command(line, &seen_positions);
+        bs = parse_position_command(line, bs, &seen_positions);
     }
     else if (starts_with("go", line))
     {
@@ -259,7 +269,7 @@ int main(int argc, char *argv[])
     SetConsoleOutputCP(65001); // unicode
 #endif
 
-    zobrist_init();
+    bitboard_init();
 
     if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0)
     {
@@ -1,5 +1,6 @@
 
 #include "move.h"
+#include "bitboard.h"
 #include "board.h"
 #include "piece.h"
 #include <assert.h>
@@ -49,41 +50,82 @@ PieceType promotion_to_piece_type(Promotion promotion)
     }
 }
 
-#define MOVE_EN_PASSANT_MASK (1 << 5)
-#define MOVE_PROMOTION_MASK ((1 << 2) | (1 << 3) | (1 << 4))
-#define MOVE_CASTLE_MASK ((1 << 1) | 1)
+// Flags, stored in the 4 high bits of a move
+enum MoveFlag
+{
+    MOVE_FLAG_NONE,
+    MOVE_FLAG_EN_PASSANT,
+    MOVE_FLAG_CASTLE_KINGSIDE,
+    MOVE_FLAG_CASTLE_QUEENSIDE,
+    MOVE_FLAG_PROMOTION_QUEEN, // followed by the other promotions, in the Promotion enum order
+};
+
+Move move_create(Square from, Square to, Promotion promotion, Castle castle, bool en_passant)
+{
+    assert(from >= 0 && from < 64);
+    assert(to >= 0 && to < 64);
+
+    unsigned flag = MOVE_FLAG_NONE;
+    if (promotion != PROMOTION_NONE)
+    {
+        flag = MOVE_FLAG_PROMOTION_QUEEN + (promotion - PROMOTION_QUEEN);
+    }
+    else if (castle != CASTLE_NONE)
+    {
+        flag = MOVE_FLAG_CASTLE_KINGSIDE + (castle - CASTLE_KINGSIDE);
+    }
+    else if (en_passant)
+    {
+        flag = MOVE_FLAG_EN_PASSANT;
+    }
 
-Move move_create(Pos from, Pos to, Promotion promotion, Castle castle, bool en_passant)
+    return (Move)(from | (to << 6) | (flag << 12));
+}
+Square move_from(Move m)
+{
+    return (Square)(m & 63);
+}
+Square move_to(Move m)
 {
-    return (Move){.from = from, .to = to, .special = (en_passant << 5) | (promotion << 2) | castle};
+    return (Square)((m >> 6) & 63);
 }
-bool move_get_en_passant(Move *m)
+bool move_get_en_passant(Move m)
 {
-    return (bool)((m->special & MOVE_EN_PASSANT_MASK) >> 5);
+    return (m >> 12) == MOVE_FLAG_EN_PASSANT;
 }
-Promotion move_get_promotion(Move *m)
+Promotion move_get_promotion(Move m)
 {
-    return (Promotion)((m->special & MOVE_PROMOTION_MASK) >> 2);
+    unsigned flag = m >> 12;
+    return flag >= MOVE_FLAG_PROMOTION_QUEEN ? (Promotion)(PROMOTION_QUEEN + (flag - MOVE_FLAG_PROMOTION_QUEEN))
+                                             : PROMOTION_NONE;
 }
-Castle move_get_castle(Move *m)
+Castle move_get_castle(Move m)
 {
-    return (Castle)(m->special & MOVE_CASTLE_MASK);
+    unsigned flag = m >> 12;
+    if (flag == MOVE_FLAG_CASTLE_KINGSIDE)
+    {
+        return CASTLE_KINGSIDE;
+    }
+    if (flag == MOVE_FLAG_CASTLE_QUEENSIDE)
+    {
+        return CASTLE_QUEENSIDE;
+    }
+    return CASTLE_NONE;
 }
 
 bool move_equals(Move a, Move b)
 {
-    return a.to.x == b.to.x && a.to.y == b.to.y && a.from.x == b.from.x && a.from.y == b.from.y &&
-           a.special == b.special;
+    return a == b;
 }
 
 void move_to_long_notation(Move move, char buffer[6])
 {
     assert(buffer != NULL);
 
-    pos_to_string(move.from, buffer);
-    pos_to_string(move.to, buffer + 2);
+    pos_to_string(square_to_pos(move_from(move)), buffer);
+    pos_to_string(square_to_pos(move_to(move)), buffer + 2);
 
-    switch (move_get_promotion(&move))
+    switch (move_get_promotion(move))
     {
     case PROMOTION_QUEEN:
         buffer[4] = 'q';
@@ -163,7 +205,7 @@ Move parse_long_notation(BoardState *bs, char buffer[6])
     bool en_passant = to.y == en_passant_y && is_pawn(get_piece(bs, from)) && is_empty(get_piece(bs, to)) &&
                       is_pawn(get_piece(bs, (Pos){to.x, from.y}));
 
-    return move_create(from, to, promotion, castle, en_passant);
+    return move_create(pos_to_square(from), pos_to_square(to), promotion, castle, en_passant);
 }
 
 #define POS_NOT_SPECIFIED -9
@@ -338,45 +380,45 @@ Move parse_algebraic_notation(BoardState *bs, char *buffer)
     AlgebraicNotation an = parse_algebraic_notation_AN(buffer);
 
     // AlgebraicNotation -> Move
-    Array(Move) moves = array_create_size(Move, 32);
+    MoveList moves;
+    move_list_init(&moves);
     generate_legal_moves(bs, bs->turn, &moves);
 
     // find move that match the algebraic notation
-    Move matching_move = {0};
-    for (size_t i = 0; i < array_len(moves); i++)
+    Move matching_move = MOVE_NONE;
+    for (size_t i = 0; i < moves.len; i++)
     {
-        Move move = moves[i];
+        Move move = moves.moves[i];
 
         // For castles, only need to match castle property, rest is ignored
-        if (an.castle != CASTLE_NONE && an.castle == move_get_castle(&move))
+        if (an.castle != CASTLE_NONE && an.castle == move_get_castle(move))
         {
             matching_move = move;
             break;
         }
 
         // match piece type
-        if (get_type(get_piece(bs, move.from)) != an.piece_type)
+        Pos from = square_to_pos(move_from(move));
+        if (get_type(get_piece(bs, from)) != an.piece_type)
             continue;
 
         // match to square
-        if (an.to.x != move.to.x || an.to.y != move.to.y)
+        if (pos_to_square(an.to) != move_to(move))
             continue;
 
         // match from square
-        if (an.from.x != POS_NOT_SPECIFIED && an.from.x != move.from.x)
+        if (an.from.x != POS_NOT_SPECIFIED && an.from.x != from.x)
             continue;
-        if (an.from.y != POS_NOT_SPECIFIED && an.from.y != move.from.y)
+        if (an.from.y != POS_NOT_SPECIFIED && an.from.y != from.y)
             continue;
 
         // match promotion
-        if (an.promotion != PROMOTION_NONE && an.promotion != move_get_promotion(&move))
+        if (an.promotion != PROMOTION_NONE && an.promotion != move_get_promotion(move))
             continue;
 
         matching_move = move;
         break;
     }
 
-    array_free(moves);
-
     return matching_move;
 }
@@ -18,6 +18,9 @@ typedef struct Pos
     int8_t y;
 } Pos;
 
+// Squares are indexed like the board, x + y * 8, y = 0 being the 8th rank (a8 = 0, h1 = 63)
+typedef int8_t Square;
+
 void pos_to_string(Pos pos, char *buffer);
 Pos parse_pos(char *buffer);
 
@@ -39,18 +42,38 @@ typedef enum Castle
     CASTLE_QUEENSIDE,
 } Castle;
 
-typedef struct Move
+// (6 bits) from square, (6 bits) to square, (4 bits) flags: en passant, castle or promotion
+typedef uint16_t Move;
+
+#define MOVE_NONE ((Move)0) // a8a8, never a real move
+
+// No legal position has more than 218 moves
+#define MAX_MOVES 256
+
+// Fixed capacity move list, lives on the stack so generating moves never allocates
+typedef struct MoveList
+{
+    Move moves[MAX_MOVES];
+    size_t len;
+} MoveList;
+
+static inline void move_list_init(MoveList *ml)
 {
-    Pos from;
-    Pos to;
-    uint8_t special;         // (1 bit) en_passant, (3 bits) promotion, (2 bits) castle
-    double order_move_score; // used for sorting moves
-} Move;
-
-Move move_create(Pos from, Pos to, Promotion promotion, Castle castle, bool en_passant);
-bool move_get_en_passant(Move *m);
-Promotion move_get_promotion(Move *m);
-Castle move_get_castle(Move *m);
+    ml->len = 0;
+}
+
+static inline void move_list_push(MoveList *ml, Move move)
+{
+    assert(ml->len < MAX_MOVES);
+    ml->moves[ml->len++] = move;
+}
+
+Move move_create(Square from, Square to, Promotion promotion, Castle castle, bool en_passant);
+Square move_from(Move m);
+Square move_to(Move m);
+bool move_get_en_passant(Move m);
+Promotion move_get_promotion(Move m);
+Castle move_get_castle(Move m);
 
 bool move_equals(Move a, Move b);
 
@@ -0,0 +1,279 @@
+#include "move_picker.h"
+#include "bitboard.h"
+#include "board.h"
+#include "evaluation.h"
+#include "move.h"
+#include "piece.h"
+#include "see.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+
+// Losing noisy moves are pushed below every other move
+#define LOSING_NOISY_PENALTY 1000000
+// Evading by capturing the checker comes before moving away or blocking
+#define EVASION_NOISY_BONUS 100000
+#define CACHE_MOVE_BONUS 1000
+
+static void score_noisy(MovePicker *mp, Move cache_move, bool penalize_losing)
+{
+    BoardState *bs = mp->bs;
+
+    for (size_t i = 0; i < mp->noisy_end; i++)
+    {
+        Move move = mp->moves.moves[i];
+        PieceType attacker = get_type(piece_on(bs, move_from(move)));
+        PieceType victim = move_get_en_passant(move) ? PT_PAWN : get_type(piece_on(bs, move_to(move)));
+
+        double score = 0;
+        if (victim != 0)
+        {
+            score += 10 * piece_value[victim] - piece_value[attacker];
+        }
+        if (move_get_promotion(move) != PROMOTION_NONE)
+        {
+            score += piece_value[promotion_to_piece_type(move_get_promotion(move))];
+        }
+
+        // Loses material once the exchange on the target square is played out
+        if (penalize_losing && !see_ge(bs, move, 0))
+        {
+            score -= LOSING_NOISY_PENALTY;
+        }
+
+        if (move_equals(move, cache_move))
+        {
+            score += CACHE_MOVE_BONUS;
+        }
+
+        mp->scores[i] = (int32_t)score;
+    }
+}
+
+static int32_t score_quiet(BoardState *bs, Move move, Bitboard pawns_attacks_bb)
+{
+    // Penalize moving into a pawn attack
+    int32_t score = 0;
+    if (pawns_attacks_bb & square_bb(move_to(move)))
+    {
+        score -= (int32_t)piece_value[get_type(piece_on(bs, move_from(move)))];
+    }
+
+    return score;
+}
+
+static void score_quiets(MovePicker *mp)
+{
+    BoardState *bs = mp->bs;
+    Bitboard pawns_attacks_bb =
+        generate_pawns_attack_bitboard(bs, bs->turn == C_WHITE ? C_BLACK : C_WHITE); // get color from moves ?
+
+    for (size_t i = mp->noisy_end; i < mp->moves.len; i++)
+    {
+        mp->scores[i] = score_quiet(bs, mp->moves.moves[i], pawns_attacks_bb);
+    }
+}
+
+static void score_evasions(MovePicker *mp)
+{
+    BoardState *bs = mp->bs;
+    Bitboard pawns_attacks_bb = generate_pawns_attack_bitboard(bs, bs->turn == C_WHITE ? C_BLACK : C_WHITE);
+
+    for (size_t i = 0; i < mp->moves.len; i++)
+    {
+        Move move = mp->moves.moves[i];
+        if (!move_is_noisy(bs, move))
+        {
+            mp->scores[i] = score_quiet(bs, move, pawns_attacks_bb);
+            continue;
+        }
+
+        PieceType attacker = get_type(piece_on(bs, move_from(move)));
+        PieceType victim = move_get_en_passant(move) ? PT_PAWN : get_type(piece_on(bs, move_to(move)));
+        mp->scores[i] = EVASION_NOISY_BONUS + (int32_t)(10 * piece_value[victim] - piece_value[attacker]);
+    }
+}
+
+// Partial selection sort over [mp->index, end), stops at the first move scoring below min_score
+static bool select_best(MovePicker *mp, size_t end, int32_t min_score, Move *out_move)
+{
+    while (mp->index < end)
+    {
+        size_t best = mp->index;
+        for (size_t i = mp->index + 1; i < end; i++)
+        {
+            if (mp->scores[i] > mp->scores[best])
+            {
+                best = i;
+            }
+        }
+
+        if (mp->scores[best] < min_score)
+        {
+            return false;
+        }
+
+        Move move = mp->moves.moves[best];
+        int32_t score = mp->scores[best];
+        mp->moves.moves[best] = mp->moves.moves[mp->index];
+        mp->scores[best] = mp->scores[mp->index];
+        mp->moves.moves[mp->index] = move;
+        mp->scores[mp->index] = score;
+        mp->index++;
+
+        // Already handed out by an earlier stage
+        if (mp->stage != MP_STAGE_QSEARCH && move == mp->tt_move)
+        {
+            continue;
+        }
+        if (mp->stage == MP_STAGE_QUIETS && (move == mp->killers[0] || move == mp->killers[1]))
+        {
+            continue;
+        }
+
+        *out_move = move;
+        return true;
+    }
+
+    return false;
+}
+
+static void picker_init(MovePicker *mp, BoardState *bs, Move tt_move, Move killers[2], MovePickerStage stage)
+{
+    assert(mp != NULL);
+    assert(bs != NULL);
+
+    mp->bs = bs;
+    move_list_init(&mp->moves);
+    mp->index = 0;
+    mp->noisy_end = 0;
+    mp->losing_index = 0;
+    mp->stage = stage;
+    mp->tt_move = tt_move;
+    mp->killers[0] = killers != NULL ? killers[0] : MOVE_NONE;
+    mp->killers[1] = killers != NULL ? killers[1] : MOVE_NONE;
+    mp->killer_index = 0;
+    mp->in_check = false;
+}
+
+void move_picker_init(MovePicker *mp, BoardState *bs, Move tt_move, Move killers[2])
+{
+    picker_init(mp, bs, tt_move, killers, MP_STAGE_TT_MOVE);
+    mp->in_check = is_in_check(bs, bs->turn);
+}
+
+void move_picker_init_qsearch(MovePicker *mp, BoardState *bs, Move tt_move)
+{
+    picker_init(mp, bs, tt_move, NULL, MP_STAGE_QSEARCH_INIT);
+}
+
+bool move_picker_next(MovePicker *mp, Move *out_move)
+{
+    assert(mp != NULL);
+    assert(out_move != NULL);
+
+    switch (mp->stage)
+    {
+    case MP_STAGE_TT_MOVE:
+        mp->stage = mp->in_check ? MP_STAGE_EVASIONS_INIT : MP_STAGE_NOISY_INIT;
+        // Played before any generation, a hash collision can store a move of another position
+        if (is_move_legal(mp->bs, mp->tt_move))
+        {
+            *out_move = mp->tt_move;
+            return true;
+        }
+        return move_picker_next(mp, out_move);
+
+    case MP_STAGE_NOISY_INIT:
+        generate_noisy_moves(mp->bs, mp->bs->turn, &mp->moves);
+        mp->noisy_end = (uint32_t)mp->moves.len;
+        score_noisy(mp, MOVE_NONE, true);
+        mp->index = 0;
+        mp->stage = MP_STAGE_WINNING_NOISY;
+        // fall through
+
+    case MP_STAGE_WINNING_NOISY:
+        if (select_best(mp, mp->noisy_end, -LOSING_NOISY_PENALTY / 2, out_move))
+        {
+            return true;
+        }
+        mp->losing_index = mp->index;
+        mp->stage = MP_STAGE_KILLERS;
+        // fall through
+
+    case MP_STAGE_KILLERS:
+        while (mp->killer_index < 2)
+        {
+            Move killer = mp->killers[mp->killer_index++];
+            // Killers come from sibling positions, they may be illegal or a capture here
+            if (killer != mp->tt_move && is_move_legal(mp->bs, killer) && !move_is_noisy(mp->bs, killer))
+            {
+                *out_move = killer;
+                return true;
+            }
+        }
+        mp->stage = MP_STAGE_QUIETS_INIT;
+        // fall through
+
+    case MP_STAGE_QUIETS_INIT:
+        generate_quiet_moves(mp->bs, mp->bs->turn, &mp->moves);
+        score_quiets(mp);
+        mp->index = mp->noisy_end;
+        mp->stage = MP_STAGE_QUIETS;
+        // fall through
+
+    case MP_STAGE_QUIETS:
+        if (select_best(mp, mp->moves.len, INT32_MIN, out_move))
+        {
+            return true;
+        }
+        mp->index = mp->losing_index;
+        mp->stage = MP_STAGE_LOSING_NOISY;
+        // fall through
+
+    case MP_STAGE_LOSING_NOISY:
+        if (select_best(mp, mp->noisy_end, INT32_MIN, out_move))
+        {
+            return true;
+        }
+        mp->stage = MP_STAGE_DONE;
+        // fall through
+
+    case MP_STAGE_DONE:
+        return false;
+
+    case MP_STAGE_EVASIONS_INIT:
+        generate_evasions(mp->bs, mp->bs->turn, &mp->moves);
+        score_evasions(mp);
+        mp->index = 0;
+        mp->stage = MP_STAGE_EVASIONS;
+        // fall through
+
+    case MP_STAGE_EVASIONS:
+        if (select_best(mp, mp->moves.len, INT32_MIN, out_move))
+        {
+            return true;
+        }
+        mp->stage = MP_STAGE_DONE;
+        return false;
+
+    case MP_STAGE_QSEARCH_INIT:
+        generate_noisy_moves(mp->bs, mp->bs->turn, &mp->moves);
+        mp->noisy_end = (uint32_t)mp->moves.len;
+        score_noisy(mp, mp->tt_move, false);
+        mp->index = 0;
+        mp->stage = MP_STAGE_QSEARCH;
+        // fall through
+
+    case MP_STAGE_QSEARCH:
+        if (select_best(mp, mp->noisy_end, INT32_MIN, out_move))
+        {
+            return true;
+        }
+        mp->stage = MP_STAGE_DONE;
+        return false;
+    }
+
+    assert(false && "Invalid move picker stage");
+    return false;
+}
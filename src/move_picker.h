@@ -0,0 +1,57 @@
+#pragma once
+
+#include "board.h"
+#include "common.h"
+#include "move.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Moves are handed out in stages, so a cutoff on an early move skips the work of the later stages
+typedef enum MovePickerStage
+{
+    MP_STAGE_TT_MOVE,
+    MP_STAGE_NOISY_INIT,
+    MP_STAGE_WINNING_NOISY,
+    MP_STAGE_KILLERS,
+    MP_STAGE_QUIETS_INIT,
+    MP_STAGE_QUIETS,
+    MP_STAGE_LOSING_NOISY,
+    MP_STAGE_DONE,
+
+    // In check, only evasions
+    MP_STAGE_EVASIONS_INIT,
+    MP_STAGE_EVASIONS,
+
+    // Quiescence search, only captures and promotions
+    MP_STAGE_QSEARCH_INIT,
+    MP_STAGE_QSEARCH,
+} MovePickerStage;
+
+typedef struct MovePicker
+{
+    BoardState *bs;
+    MoveList moves;            // noisy moves (captures and promotions) first, then quiets
+    int32_t scores[MAX_MOVES]; // [index in moves]
+    uint32_t index;            // next move to select, indices are below MAX_MOVES
+    uint32_t noisy_end;        // noisy moves are [0, noisy_end)
+    uint32_t losing_index;     // first losing noisy move, once the winning ones have been handed out
+    MovePickerStage stage;
+    Move tt_move;
+    Move killers[2];
+    uint8_t killer_index;
+    bool in_check;
+} MovePicker;
+
+// killers can be NULL
+void move_picker_init(MovePicker *mp, BoardState *bs, Move tt_move, Move killers[2]);
+void move_picker_init_qsearch(MovePicker *mp, BoardState *bs, Move tt_move);
+
+// False once every legal move has been handed out, each move is handed out once
+bool move_picker_next(MovePicker *mp, Move *out_move);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #include "perft.h"
+#include "array.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -7,35 +8,266 @@
 #define SCHED_IMPLEMENTATION
 #include <sched_lib.h>
 
-size_t perft(BoardState bs, int depth)
+// Make/unmake on a single board
+static size_t perft_in_place(BoardState *bs, int depth)
 {
     if (depth == 0)
     {
         return 1;
     }
 
-    Array(Move) moves = array_create_size(Move, 32);
-    generate_legal_moves(&bs, bs.turn, &moves);
+    MoveList moves;
+    move_list_init(&moves);
+    generate_legal_moves(bs, bs->turn, &moves);
 
     if (depth == 1)
     {
-        size_t nodes = array_len(moves);
-        array_free(moves);
-        return nodes;
+        return moves.len;
     }
 
     size_t nodes = 0;
-    for (size_t i = 0; i < array_len(moves); i++)
+    for (size_t i = 0; i < moves.len; i++)
     {
-        BoardState new_bs = bs;
-        make_move(&new_bs, moves[i]);
-        nodes += perft(new_bs, depth - 1);
+        MoveUndo undo;
+        make_move_undo(bs, moves.moves[i], &undo);
+        nodes += perft_in_place(bs, depth - 1);
+        unmake_move(bs, moves.moves[i], &undo);
     }
-    array_free(moves);
 
     return nodes;
 }
 
+size_t perft(BoardState bs, int depth)
+{
+    return perft_in_place(&bs, depth);
+}
+
+PerftTable perft_table_create(size_t size_mb)
+{
+    PerftTable table = {0};
+
+    // Power of two, so the index is a mask of the hash
+    size_t max_buckets = size_mb * 1024 * 1024 / sizeof(PerftBucket);
+    if (max_buckets == 0)
+    {
+        return table;
+    }
+    size_t bucket_count = 1;
+    while (bucket_count <= max_buckets / 2)
+    {
+        bucket_count *= 2;
+    }
+
+    table.buckets = calloc(bucket_count, sizeof(PerftBucket));
+    table.mask = table.buckets != NULL ? bucket_count - 1 : 0;
+    return table;
+}
+
+void perft_table_free(PerftTable *table)
+{
+    assert(table != NULL);
+
+    free(table->buckets);
+    table->buckets = NULL;
+    table->mask = 0;
+}
+
+void perft_table_clear(PerftTable *table)
+{
+    assert(table != NULL);
+
+    if (table->buckets != NULL)
+    {
+        memset(table->buckets, 0, (table->mask + 1) * sizeof(PerftBucket));
+    }
+}
+
+// Every depth of a position lands in a different bucket
+static volatile PerftEntry *perft_bucket(PerftTable *table, uint64_t hash, int depth)
+{
+    size_t index = (size_t)(hash ^ ((uint64_t)depth * 0x9E3779B97F4A7C15ULL)) & table->mask;
+    return table->buckets[index].entries;
+}
+
+// Entries are read and written by several threads at once, volatile makes each field a single load or store so
+// the key check sees the same data it returns
+static bool perft_table_probe(PerftTable *table, uint64_t hash, int depth, uint64_t *out_nodes)
+{
+    volatile PerftEntry *bucket = perft_bucket(table, hash, depth);
+    for (size_t i = 0; i < PERFT_BUCKET_SIZE; i++)
+    {
+        uint64_t key = bucket[i].key;
+        uint64_t data = bucket[i].data;
+        if ((data & 0xFF) == (uint64_t)depth && (key ^ data) == hash)
+        {
+            *out_nodes = data >> 8;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Replaces the shallowest entry of the bucket, the deepest counts are the most expensive to redo
+static void perft_table_store(PerftTable *table, uint64_t hash, int depth, uint64_t nodes)
+{
+    assert(depth > 0 && depth <= 0xFF);
+    assert(nodes < (1ULL << 56));
+
+    volatile PerftEntry *bucket = perft_bucket(table, hash, depth);
+    size_t replace = 0;
+    for (size_t i = 0; i < PERFT_BUCKET_SIZE; i++)
+    {
+        if ((bucket[i].data & 0xFF) < (bucket[replace].data & 0xFF))
+        {
+            replace = i;
+        }
+    }
+
+    uint64_t data = nodes << 8 | (uint64_t)depth;
+    bucket[replace].key = hash ^ data;
+    bucket[replace].data = data;
+}
+
+// perft_in_place, looking up subtrees of 3 plies or more, smaller ones are cheaper to count than a table access
+static uint64_t perft_in_place_hashed(BoardState *bs, int depth, PerftTable *table)
+{
+    if (depth <= 2)
+    {
+        return perft_in_place(bs, depth);
+    }
+
+    uint64_t nodes = 0;
+    if (perft_table_probe(table, bs->zobrist_hash, depth, &nodes))
+    {
+        return nodes;
+    }
+
+    MoveList moves;
+    move_list_init(&moves);
+    generate_legal_moves(bs, bs->turn, &moves);
+
+    for (size_t i = 0; i < moves.len; i++)
+    {
+        MoveUndo undo;
+        make_move_undo(bs, moves.moves[i], &undo);
+        nodes += perft_in_place_hashed(bs, depth - 1, table);
+        unmake_move(bs, moves.moves[i], &undo);
+    }
+
+    perft_table_store(table, bs->zobrist_hash, depth, nodes);
+    return nodes;
+}
+
+uint64_t perft_hashed(BoardState *bs, int depth, PerftTable *table)
+{
+    assert(bs != NULL);
+    assert(table != NULL);
+
+    BoardState copy = *bs;
+    if (table->buckets == NULL)
+    {
+        return perft_in_place(&copy, depth);
+    }
+
+    return perft_in_place_hashed(&copy, depth, table);
+}
+
+// Counts move of bs before it is made, true if it gives check (classified by stats_count_check once made)
+static bool stats_count_move(BoardState *bs, const CheckInfo *ci, Move move, PerftStats *stats)
+{
+    stats->nodes++;
+    if (move_get_en_passant(move))
+    {
+        stats->captures++;
+        stats->en_passants++;
+    }
+    else if (!is_empty(piece_on(bs, move_to(move))))
+    {
+        stats->captures++;
+    }
+    if (move_get_castle(move) != CASTLE_NONE)
+    {
+        stats->castles++;
+    }
+    if (move_get_promotion(move) != PROMOTION_NONE)
+    {
+        stats->promotions++;
+    }
+
+    return gives_check(bs, ci, move);
+}
+
+// bs is the position after move, its side to move is in check
+static void stats_count_check(BoardState *bs, Move move, PerftStats *stats)
+{
+    Color checker_color = bs->turn == C_WHITE ? C_BLACK : C_WHITE;
+    Square king_sq = lsb(get_pieces_bitboard(bs, PT_KING, (Color)bs->turn));
+    Bitboard checkers = attackers_to(bs, king_sq, get_occupied_bitboard(bs)) & get_color_bitboard(bs, checker_color);
+    assert(checkers != BB_EMPTY);
+
+    // The moved piece checks from its target square, a castling rook from next to the king's start square
+    Square from = move_from(move);
+    Bitboard moved = square_bb(move_to(move));
+    if (move_get_castle(move) != CASTLE_NONE)
+    {
+        moved |= square_bb(move_get_castle(move) == CASTLE_KINGSIDE ? from + 1 : from - 1);
+    }
+
+    // As the usual reference tables, a double check isn't also counted as discovered
+    stats->checks++;
+    if ((checkers & (checkers - 1)) != BB_EMPTY)
+    {
+        stats->double_checks++;
+    }
+    else if ((checkers & ~moved) != BB_EMPTY)
+    {
+        stats->discovered_checks++;
+    }
+
+    MoveList evasions;
+    move_list_init(&evasions);
+    generate_evasions(bs, (Color)bs->turn, &evasions);
+    if (evasions.len == 0)
+    {
+        stats->checkmates++;
+    }
+}
+
+// Moves of bs go to stats[0], the moves of the next ply to stats[1] and so on
+static void perft_stats_in_place(BoardState *bs, int depth, PerftStats *stats)
+{
+    if (depth == 0)
+    {
+        return;
+    }
+
+    MoveList moves;
+    move_list_init(&moves);
+    generate_legal_moves(bs, bs->turn, &moves);
+
+    CheckInfo ci;
+    check_info_init(bs, &ci);
+
+    for (size_t i = 0; i < moves.len; i++)
+    {
+        bool check = stats_count_move(bs, &ci, moves.moves[i], stats);
+
+        // Leaves are only made to look at their check
+        if (depth > 1 || check)
+        {
+            MoveUndo undo;
+            make_move_undo(bs, moves.moves[i], &undo);
+            if (check)
+            {
+                stats_count_check(bs, moves.moves[i], stats);
+            }
+            perft_stats_in_place(bs, depth - 1, stats + 1);
+            unmake_move(bs, moves.moves[i], &undo);
+        }
+    }
+}
+
 typedef struct PerftThreadData
 {
     SDL_Thread *thread;
@@ -53,16 +285,17 @@ int perft_thread_sdl(void *args_)
         return 0;
     }
 
-    Array(Move) moves = array_create(Move);
+    MoveList moves;
+    move_list_init(&moves);
     generate_legal_moves(&args->bs, args->bs.turn, &moves);
 
-    Array(PerfThreadData) threads_data = array_create_size(PerfThreadData, array_len(moves)); // Re-alloc causes issues
+    Array(PerfThreadData) threads_data = array_create_size(PerfThreadData, moves.len); // Re-alloc causes issues
 
     uint64_t nodes = 0;
-    for (size_t i = 0; i < array_len(moves); i++)
+    for (size_t i = 0; i < moves.len; i++)
     {
         BoardState new_bs = args->bs;
-        make_move(&new_bs, moves[i]);
+        make_move(&new_bs, moves.moves[i]);
 
         // Start a new thread if available, otherwise compute in this thread
         if (SDL_SemTryWait(args->sem) == 0)
@@ -88,7 +321,6 @@ int perft_thread_sdl(void *args_)
             nodes += ret;
         }
     }
-    array_free(moves);
 
     for (size_t i = 0; i < array_len(threads_data); i++)
     {
@@ -103,96 +335,254 @@ int perft_thread_sdl(void *args_)
     return 0;
 }
 
-typedef struct PerftThreadSchedData
+// A node split into one task per move, its moves are partitioned between the threads
+typedef struct PerftSplitNode
 {
+    struct sched_task task;
+    struct PerftContext *ctx;
     BoardState bs;
-    int depth;
-    uint64_t ret;
-} PerftThreadSchedData;
-static void perft_thread_sched_task(void *args_, struct scheduler *sched, struct sched_task_partition partition,
-                                    sched_uint thread_num)
+    MoveList moves;
+    CheckInfo ci;              // only with stats
+    uint64_t nodes[MAX_MOVES]; // [move index]
+    int depth;                 // of the children
+    int reserved;              // explicit tail padding
+} PerftSplitNode;
+
+// Split nodes of a thread, they are joined before their parent so they are freed in reverse order
+typedef struct PerftNodePool
 {
-    (void)partition;
-    (void)thread_num;
-    PerftThreadSchedData *args = (PerftThreadSchedData *)args_;
+    PerftSplitNode *nodes;
+    size_t len;
+    size_t cap;
+} PerftNodePool;
 
-    if (args->depth == 0)
+typedef struct PerftContext
+{
+    struct scheduler sched;
+    PerftNodePool *pools; // [thread]
+    PerftTable *table;    // NULL if none
+    PerftStats *stats;    // [thread * depth + ply], NULL for a node count only
+    int depth;
+    int split_depth;
+} PerftContext;
+
+// Nodes one thread keeps per split depth, a thread waiting on a join runs other tasks that may split again
+#define PERFT_POOL_NODES_PER_DEPTH 4
+
+static PerftSplitNode *pool_alloc(PerftNodePool *pool)
+{
+    if (pool->len < pool->cap)
     {
-        args->ret = 1;
-        return;
+        return &pool->nodes[pool->len++];
     }
 
-    Array(Move) moves = array_create_size(Move, 32);
-    generate_legal_moves(&args->bs, args->bs.turn, &moves);
+    // Deeper nesting than planned, still correct
+    PerftSplitNode *node = malloc(sizeof(PerftSplitNode));
+    assert(node != NULL);
+    return node;
+}
 
-    if (args->depth == 1)
+static void pool_free(PerftNodePool *pool, PerftSplitNode *node)
+{
+    if (pool->cap > 0 && node >= pool->nodes && node < pool->nodes + pool->cap)
     {
-        args->ret = array_len(moves);
-        array_free(moves);
-        return;
+        assert(node == &pool->nodes[pool->len - 1]);
+        pool->len--;
+    }
+    else
+    {
+        free(node);
     }
+}
+
+static uint64_t perft_split(PerftContext *ctx, BoardState *bs, int depth, sched_uint thread_num);
 
-    struct sched_task *tasks = malloc(sizeof(struct sched_task) * array_len(moves));
-    PerftThreadSchedData *task_args = malloc(sizeof(PerftThreadSchedData) * array_len(moves));
+static void perft_split_task(void *args, struct scheduler *sched, struct sched_task_partition partition,
+                             sched_uint thread_num)
+{
+    (void)sched;
+    PerftSplitNode *node = (PerftSplitNode *)args;
 
-    for (size_t i = 0; i < array_len(moves); i++)
+    PerftContext *ctx = node->ctx;
+    for (sched_uint i = partition.start; i < partition.end; i++)
     {
-        BoardState new_bs = args->bs;
-        make_move(&new_bs, moves[i]);
+        BoardState child = node->bs;
+        Move move = node->moves.moves[i];
 
-        task_args[i] = (PerftThreadSchedData){.bs = new_bs, .depth = args->depth - 1, .ret = 0};
+        if (ctx->stats != NULL)
+        {
+            PerftStats *stats = &ctx->stats[thread_num * (size_t)ctx->depth + (size_t)(ctx->depth - node->depth - 1)];
+            bool check = stats_count_move(&child, &node->ci, move, stats);
+            make_move(&child, move);
+            if (check)
+            {
+                stats_count_check(&child, move, stats);
+            }
+        }
+        else
+        {
+            make_move(&child, move);
+        }
 
-        scheduler_add(sched, &tasks[i], &perft_thread_sched_task, &task_args[i], 0, 0);
+        node->nodes[i] = perft_split(ctx, &child, node->depth, thread_num);
+    }
+}
+
+static uint64_t perft_split(PerftContext *ctx, BoardState *bs, int depth, sched_uint thread_num)
+{
+    // Small subtrees are not worth a task
+    if (depth <= ctx->split_depth)
+    {
+        if (ctx->stats != NULL)
+        {
+            perft_stats_in_place(bs, depth, &ctx->stats[thread_num * (size_t)ctx->depth + (size_t)(ctx->depth - depth)]);
+            return 0;
+        }
+        return ctx->table != NULL ? perft_in_place_hashed(bs, depth, ctx->table) : perft_in_place(bs, depth);
     }
 
     uint64_t total = 0;
-    for (size_t i = 0; i < array_len(moves); i++)
+    if (ctx->table != NULL && perft_table_probe(ctx->table, bs->zobrist_hash, depth, &total))
+    {
+        return total;
+    }
+
+    PerftNodePool *pool = &ctx->pools[thread_num];
+    PerftSplitNode *node = pool_alloc(pool);
+    node->ctx = ctx;
+    node->bs = *bs;
+    node->depth = depth - 1;
+    move_list_init(&node->moves);
+    generate_legal_moves(&node->bs, node->bs.turn, &node->moves);
+    if (ctx->stats != NULL)
     {
-        scheduler_join(sched, &tasks[i]);
-        total += task_args[i].ret;
+        check_info_init(&node->bs, &node->ci);
     }
-    array_free(moves);
-    free(tasks);
-    free(task_args);
 
-    args->ret = total;
+    if (node->moves.len > 0)
+    {
+        scheduler_add(&ctx->sched, &node->task, perft_split_task, node, (sched_uint)node->moves.len, 1);
+        scheduler_join(&ctx->sched, &node->task);
+
+        for (size_t i = 0; i < node->moves.len; i++)
+        {
+            total += node->nodes[i];
+        }
+    }
+
+    pool_free(pool, node);
+
+    if (ctx->table != NULL)
+    {
+        perft_table_store(ctx->table, bs->zobrist_hash, depth, total);
+    }
+    return total;
 }
 
-uint64_t perft_thread_sched(BoardState *bs, int depth)
+// Node count, or with out_stats the breakdown of each ply (the returned count is then 0)
+static uint64_t perft_run(BoardState *bs, int depth, int threads, int split_depth, PerftTable *table,
+                          PerftStats *out_stats)
 {
+    assert(bs != NULL);
+    assert(depth >= 0);
+    assert(threads >= 0);
+    assert(split_depth >= 1);
+
+    PerftContext ctx = {
+        .table = table != NULL && table->buckets != NULL ? table : NULL,
+        .depth = depth,
+        .split_depth = split_depth,
+    };
+
     sched_size sched_needed_memory;
-    struct scheduler sched;
-    scheduler_init(&sched, &sched_needed_memory, SCHED_DEFAULT, NULL);
+    scheduler_init(&ctx.sched, &sched_needed_memory, threads == 0 ? SCHED_DEFAULT : threads, NULL);
     void *sched_memory = calloc(sched_needed_memory, 1);
-    scheduler_start(&sched, sched_memory);
 
-    struct sched_task task;
-    PerftThreadSchedData task_args = {.bs = *bs, .depth = depth, .ret = 0};
-    scheduler_add(&sched, &task, &perft_thread_sched_task, &task_args, 0, 0);
-    scheduler_join(&sched, &task);
+    // Allocated once, no allocation while counting
+    size_t threads_num = ctx.sched.threads_num;
+    size_t pool_cap = depth > split_depth ? (size_t)(depth - split_depth) * PERFT_POOL_NODES_PER_DEPTH : 0;
+    ctx.pools = calloc(threads_num, sizeof(PerftNodePool));
+    PerftSplitNode *pool_nodes = pool_cap > 0 ? malloc(threads_num * pool_cap * sizeof(PerftSplitNode)) : NULL;
+    assert(ctx.pools != NULL && sched_memory != NULL && (pool_cap == 0 || pool_nodes != NULL));
+    for (size_t i = 0; i < threads_num; i++)
+    {
+        ctx.pools[i] = (PerftNodePool){.nodes = pool_cap > 0 ? pool_nodes + i * pool_cap : NULL, .cap = pool_cap};
+    }
+
+    // Each thread counts on its own stats, merged once done
+    if (out_stats != NULL)
+    {
+        ctx.stats = calloc(threads_num * (size_t)depth + 1, sizeof(PerftStats));
+        assert(ctx.stats != NULL);
+    }
+
+    scheduler_start(&ctx.sched, sched_memory);
+    uint64_t nodes = perft_split(&ctx, bs, depth, 0);
+    scheduler_stop(&ctx.sched, true);
 
-    scheduler_wait(&sched);
-    scheduler_stop(&sched, true);
+    if (out_stats != NULL)
+    {
+        memset(out_stats, 0, (size_t)depth * sizeof(PerftStats));
+        for (size_t t = 0; t < threads_num; t++)
+        {
+            for (int ply = 0; ply < depth; ply++)
+            {
+                const PerftStats *thread_stats = &ctx.stats[t * (size_t)depth + (size_t)ply];
+                out_stats[ply].nodes += thread_stats->nodes;
+                out_stats[ply].captures += thread_stats->captures;
+                out_stats[ply].en_passants += thread_stats->en_passants;
+                out_stats[ply].castles += thread_stats->castles;
+                out_stats[ply].promotions += thread_stats->promotions;
+                out_stats[ply].checks += thread_stats->checks;
+                out_stats[ply].discovered_checks += thread_stats->discovered_checks;
+                out_stats[ply].double_checks += thread_stats->double_checks;
+                out_stats[ply].checkmates += thread_stats->checkmates;
+            }
+        }
+        free(ctx.stats);
+    }
+
+    free(pool_nodes);
+    free(ctx.pools);
     free(sched_memory);
 
-    return task_args.ret;
+    return nodes;
+}
+
+uint64_t perft_parallel(BoardState *bs, int depth, int threads, int split_depth, PerftTable *table)
+{
+    return perft_run(bs, depth, threads, split_depth, table, NULL);
+}
+
+void perft_stats(BoardState *bs, int depth, int threads, int split_depth, PerftStats *out_stats)
+{
+    assert(out_stats != NULL || depth == 0);
+
+    perft_run(bs, depth, threads, split_depth, NULL, out_stats);
+}
+
+uint64_t perft_thread_sched(BoardState *bs, int depth)
+{
+    return perft_parallel(bs, depth, 0, PERFT_DEFAULT_SPLIT_DEPTH, NULL);
 }
 
 void divide(BoardState bs, int depth)
 {
-    Array(Move) moves = array_create_size(Move, 32);
+    MoveList moves;
+    move_list_init(&moves);
     generate_legal_moves(&bs, bs.turn, &moves);
 
     uint64_t total = 0;
-    for (size_t i = 0; i < array_len(moves); i++)
+    for (size_t i = 0; i < moves.len; i++)
     {
-        BoardState new_bs = bs;
-        make_move(&new_bs, moves[i]);
+        MoveUndo undo;
+        make_move_undo(&bs, moves.moves[i], &undo);
 
         char notation[6];
-        move_to_long_notation(moves[i], notation);
+        move_to_long_notation(moves.moves[i], notation);
 
-        uint64_t nodes = perft(new_bs, depth - 1);
+        uint64_t nodes = perft_in_place(&bs, depth - 1);
+        unmake_move(&bs, moves.moves[i], &undo);
         total += nodes;
         printf("%s %llu\n", notation, nodes);
     }
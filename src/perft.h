@@ -10,6 +10,35 @@ extern "C" {
 
 size_t perft(BoardState bs, int depth);
 
+// Node counts keyed by (zobrist hash, depth), shared by every thread without locks.
+// An entry stores its key xored with its data, a torn write (two threads storing at once) fails the key check.
+typedef struct PerftEntry
+{
+    uint64_t key;  // zobrist hash ^ data
+    uint64_t data; // nodes << 8 | depth
+} PerftEntry;
+
+#define PERFT_BUCKET_SIZE 4
+
+typedef struct PerftBucket
+{
+    PerftEntry entries[PERFT_BUCKET_SIZE];
+} PerftBucket;
+
+typedef struct PerftTable
+{
+    size_t mask; // bucket count - 1
+    PerftBucket *buckets;
+} PerftTable;
+
+// size_mb is rounded down to a power of two number of buckets, buckets is NULL if the allocation failed
+PerftTable perft_table_create(size_t size_mb);
+void perft_table_free(PerftTable *table);
+void perft_table_clear(PerftTable *table);
+
+// perft reusing the counts of subtrees already in table
+uint64_t perft_hashed(BoardState *bs, int depth, PerftTable *table);
+
 typedef struct PerftArgs
 {
     BoardState bs;
@@ -21,8 +50,34 @@ typedef struct PerftArgs
 // args should be PerftArgs
 int perft_thread_sdl(void *args);
 
+// Plies left under which a subtree is counted by a single thread
+#define PERFT_DEFAULT_SPLIT_DEPTH 3
+
+// Splits into parallel tasks while more than split_depth plies remain, below counts serially.
+// threads is the number of threads including the calling one, 0 for one per CPU core. table can be NULL.
+uint64_t perft_parallel(BoardState *bs, int depth, int threads, int split_depth, PerftTable *table);
+
+// perft_parallel on every core with the default split depth, without table
 uint64_t perft_thread_sched(BoardState *bs, int depth);
 
+// Moves of one ply, by kind. A check can also be discovered or double.
+typedef struct PerftStats
+{
+    uint64_t nodes;
+    uint64_t captures; // with en passant
+    uint64_t en_passants;
+    uint64_t castles;
+    uint64_t promotions;
+    uint64_t checks;
+    uint64_t discovered_checks; // single check given by another piece than the moved one
+    uint64_t double_checks;
+    uint64_t checkmates;
+} PerftStats;
+
+// out_stats[i] is the breakdown of the leaves of perft(i + 1), for i < depth. Runs like perft_parallel without table,
+// the node count path doesn't pay for the breakdown.
+void perft_stats(BoardState *bs, int depth, int threads, int split_depth, PerftStats *out_stats);
+
 void divide(BoardState bs, int depth);
 
 #ifdef __cplusplus
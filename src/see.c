@@ -0,0 +1,233 @@
+#include "see.h"
+#include "bitboard.h"
+#include "board.h"
+#include "cpu.h"
+#include "evaluation.h"
+#include "move.h"
+#include "piece.h"
+#include <assert.h>
+#include <stdint.h>
+
+// Each capture removes a piece, so an exchange can't be longer than that
+#define MAX_EXCHANGES 32
+
+static int32_t see_value(PieceType pt)
+{
+    return (int32_t)piece_value[pt];
+}
+
+static Color opponent(Color c)
+{
+    return c == C_WHITE ? C_BLACK : C_WHITE;
+}
+
+// Value taken by move itself, promotions count as winning the difference with a pawn
+static int32_t captured_value(BoardState *bs, Move move)
+{
+    int32_t value = move_get_en_passant(move) ? see_value(PT_PAWN) : see_value(get_type(piece_on(bs, move_to(move))));
+
+    if (move_get_promotion(move) != PROMOTION_NONE)
+    {
+        value += see_value(promotion_to_piece_type(move_get_promotion(move))) - see_value(PT_PAWN);
+    }
+
+    return value;
+}
+
+// Value of the piece standing on the target square once move is played
+static int32_t moved_value(BoardState *bs, Move move)
+{
+    if (move_get_promotion(move) != PROMOTION_NONE)
+    {
+        return see_value(promotion_to_piece_type(move_get_promotion(move)));
+    }
+
+    return see_value(get_type(piece_on(bs, move_from(move))));
+}
+
+// Occupancy once move is played, the target square doesn't matter as it is never looked through
+static Bitboard occupied_after(BoardState *bs, Move move)
+{
+    Bitboard occupied = get_occupied_bitboard(bs) ^ square_bb(move_from(move));
+
+    if (move_get_en_passant(move))
+    {
+        Color us = get_color(piece_on(bs, move_from(move)));
+        occupied ^= square_bb((Square)(move_to(move) + (us == C_WHITE ? 8 : -8)));
+    }
+
+    return occupied;
+}
+
+// Least valuable piece of attackers, 0 if it is empty
+static PieceType least_valuable(BoardState *bs, Bitboard attackers, Bitboard *out_bb)
+{
+    for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+    {
+        Bitboard bb = attackers & bs->pieces_bb[pt - 1];
+        if (bb != BB_EMPTY)
+        {
+            *out_bb = bb & -bb;
+            return pt;
+        }
+    }
+
+    return 0;
+}
+
+// Sliders behind a piece that just left sq joins the exchange
+static Bitboard xray_attackers(BoardState *bs, Square sq, PieceType moved, Bitboard occupied)
+{
+    Bitboard queens = bs->pieces_bb[PT_QUEEN - 1];
+    Bitboard attackers = BB_EMPTY;
+
+    if (moved == PT_PAWN || moved == PT_BISHOP || moved == PT_QUEEN)
+    {
+        attackers |= bishop_attacks(sq, occupied) & (bs->pieces_bb[PT_BISHOP - 1] | queens);
+    }
+    if (moved == PT_ROOK || moved == PT_QUEEN)
+    {
+        attackers |= rook_attacks(sq, occupied) & (bs->pieces_bb[PT_ROOK - 1] | queens);
+    }
+
+    return attackers;
+}
+
+static FORCE_INLINE int32_t see_body(BoardState *bs, Move move)
+{
+    if (move_get_castle(move) != CASTLE_NONE)
+    {
+        return 0;
+    }
+
+    Square to = move_to(move);
+    Color stm = get_color(piece_on(bs, move_from(move)));
+    Bitboard occupied = occupied_after(bs, move);
+    Bitboard attackers = attackers_to_body(bs, to, occupied);
+
+    // gain[d]: material won by the side making the d-th capture if the exchange stopped right after it
+    int32_t gain[MAX_EXCHANGES + 1];
+    int d = 0;
+    gain[0] = captured_value(bs, move);
+    int32_t on_square = moved_value(bs, move);
+
+    while (d < MAX_EXCHANGES)
+    {
+        stm = opponent(stm);
+        attackers &= occupied;
+
+        Bitboard attacker_bb = BB_EMPTY;
+        PieceType pt = least_valuable(bs, attackers & get_color_bitboard(bs, stm), &attacker_bb);
+        if (pt == 0)
+        {
+            break;
+        }
+
+        // The king can't capture a defended piece
+        if (pt == PT_KING && (attackers & get_color_bitboard(bs, opponent(stm))) != BB_EMPTY)
+        {
+            break;
+        }
+
+        d++;
+        gain[d] = on_square - gain[d - 1];
+        on_square = see_value(pt);
+
+        occupied ^= attacker_bb;
+        attackers |= xray_attackers(bs, to, pt, occupied);
+    }
+
+    // Each side picks the best of capturing or stopping, from the last capture back to move
+    while (d > 0)
+    {
+        if (gain[d] > -gain[d - 1])
+        {
+            gain[d - 1] = -gain[d];
+        }
+        d--;
+    }
+
+    return gain[0];
+}
+
+// Built per ISA level like the move generator, the search runs it on most captures
+CPU_DEFINE_ISA_KERNELS(int32_t, see, (BoardState * bs, Move move), (bs, move))
+
+int32_t see(BoardState *bs, Move move)
+{
+    assert(bs != NULL);
+    assert(move != MOVE_NONE);
+
+    CPU_DISPATCH_ISA(see, (bs, move));
+}
+
+static FORCE_INLINE bool see_ge_body(BoardState *bs, Move move, int32_t threshold)
+{
+    if (move_get_castle(move) != CASTLE_NONE)
+    {
+        return 0 >= threshold;
+    }
+
+    // Even if the opponent stops, move doesn't win enough
+    int32_t swap = captured_value(bs, move) - threshold;
+    if (swap < 0)
+    {
+        return false;
+    }
+
+    // Even if the opponent takes back for free, move wins enough
+    swap = moved_value(bs, move) - swap;
+    if (swap <= 0)
+    {
+        return true;
+    }
+
+    Square to = move_to(move);
+    Color stm = get_color(piece_on(bs, move_from(move)));
+    Bitboard occupied = occupied_after(bs, move);
+    Bitboard attackers = attackers_to_body(bs, to, occupied);
+
+    // res is whether the side that played move gets threshold if the side to move runs out of good captures, swap is
+    // what the side to move has to win back to change that
+    bool res = true;
+    while (true)
+    {
+        stm = opponent(stm);
+        attackers &= occupied;
+
+        Bitboard attacker_bb = BB_EMPTY;
+        PieceType pt = least_valuable(bs, attackers & get_color_bitboard(bs, stm), &attacker_bb);
+        if (pt == 0)
+        {
+            break;
+        }
+
+        // The king can only capture an undefended piece, and then the exchange is over
+        if (pt == PT_KING)
+        {
+            return (attackers & get_color_bitboard(bs, opponent(stm))) != BB_EMPTY ? res : !res;
+        }
+
+        res = !res;
+        swap = see_value(pt) - swap;
+        if (swap < (int32_t)res)
+        {
+            break;
+        }
+
+        occupied ^= attacker_bb;
+        attackers |= xray_attackers(bs, to, pt, occupied);
+    }
+
+    return res;
+}
+
+CPU_DEFINE_ISA_KERNELS(bool, see_ge, (BoardState * bs, Move move, int32_t threshold), (bs, move, threshold))
+
+bool see_ge(BoardState *bs, Move move, int32_t threshold)
+{
+    assert(bs != NULL);
+    assert(move != MOVE_NONE);
+
+    CPU_DISPATCH_ISA(see_ge, (bs, move, threshold));
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "board.h"
+#include "common.h"
+#include "move.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Static exchange evaluation: material won by move once every capture on its target square has been played out,
+// each side always recapturing with its least valuable attacker and free to stop. Pins are ignored
+int32_t see(BoardState *bs, Move move);
+// see(bs, move) >= threshold, without playing out the exchanges that can't change the answer
+bool see_ge(BoardState *bs, Move move, int32_t threshold);
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,9 +8,9 @@
 extern "C" {
 #endif
 
-void zobrist_init(void);
-
 uint64_t zobrist_piece(Piece p, Pos pos);
+// Key of having more than count pieces like p
+uint64_t zobrist_material(Piece p, int count);
 uint64_t zobrist_black(void);
 uint64_t zobrist_castle_right(Color c, bool king_side);
 uint64_t zobrist_en_passant(int8_t file);
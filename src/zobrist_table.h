@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ZobristTable
+{
+    uint64_t pieces[2][6][8][8]; // [color][piece type][x][y], -1 is substracted from color and piece type
+    uint64_t material[2][6][16]; // [color][piece type][count], -1 is substracted from color and piece type
+    uint64_t castling[2][2];     // [color][side], -1 is substracted from color, 0 is king side, 1 is queen side
+    uint64_t black_turn;
+    uint64_t en_passant_file[8]; // [file]
+} ZobristTable;
+
+// Generated at build time by gen_zobrist, the same keys on every run and every machine
+extern const ZobristTable zobrist_table;
+
+#ifdef __cplusplus
+}
+#endif
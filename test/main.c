@@ -1,13 +1,20 @@
 #include "array.h"
+#include "batch.h"
+#include "bitboard.h"
 #include "board.h"
 #include "cache.h"
+#include "cpu.h"
+#include "epd.h"
 #include "evaluation.h"
+#include "fen.h"
 #include "greatest.h"
 #include "move.h"
+#include "move_picker.h"
 #include "perft.h"
 #include "piece.h"
-#include "zobrist.h"
+#include "see.h"
 #include <stdint.h>
+#include <string.h>
 
 TEST test_perft_default(void)
 {
@@ -31,6 +38,19 @@ TEST test_perft_kiwipete(void)
     PASS();
 }
 
+TEST test_perft_3(void)
+{
+    // En passant would leave the king in check along the rank
+    BoardState bs = load_fen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
+    ASSERT_EQ(perft_thread_sched(&bs, 1), 14);
+    ASSERT_EQ(perft_thread_sched(&bs, 2), 191);
+    ASSERT_EQ(perft_thread_sched(&bs, 3), 2812);
+    ASSERT_EQ(perft_thread_sched(&bs, 4), 43238);
+    ASSERT_EQ(perft_thread_sched(&bs, 5), 674624);
+
+    PASS();
+}
+
 TEST test_perft_6(void)
 {
     BoardState bs = load_fen("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10");
@@ -42,31 +62,556 @@ TEST test_perft_6(void)
     PASS();
 }
 
-TEST test_piece_list(void)
+TEST test_perft_parallel(void)
 {
     BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
 
-    for (Color c = C_WHITE; c <= C_BLACK; c++)
+    for (int threads = 1; threads <= 4; threads++)
+    {
+        for (int split_depth = 1; split_depth <= 4; split_depth++)
+        {
+            ASSERT_EQ(perft_parallel(&bs, 0, threads, split_depth, NULL), 1);
+            ASSERT_EQ(perft_parallel(&bs, 1, threads, split_depth, NULL), 48);
+            ASSERT_EQ(perft_parallel(&bs, 3, threads, split_depth, NULL), 97862);
+        }
+    }
+
+    // Checkmate, no move to split on
+    BoardState mate = load_fen("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+    ASSERT_EQ(perft_parallel(&mate, 3, 2, 1, NULL), 0);
+
+    PASS();
+}
+
+TEST test_perft_table(void)
+{
+    BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+    // Too small for the tree, entries are replaced all the time
+    PerftTable table = perft_table_create(1);
+    ASSERT(table.buckets != NULL);
+    ASSERT_EQ(perft_hashed(&bs, 4, &table), 4085603);
+    // Again from the filled table
+    ASSERT_EQ(perft_hashed(&bs, 4, &table), 4085603);
+    ASSERT_EQ(perft_hashed(&bs, 3, &table), 97862);
+
+    perft_table_clear(&table);
+    ASSERT_EQ(perft_parallel(&bs, 4, 4, 2, &table), 4085603);
+    ASSERT_EQ(perft_parallel(&bs, 4, 2, 3, &table), 4085603);
+    perft_table_free(&table);
+
+    // No table
+    PerftTable empty = perft_table_create(0);
+    ASSERT(empty.buckets == NULL);
+    ASSERT_EQ(perft_hashed(&bs, 2, &empty), 2039);
+    ASSERT_EQ(perft_parallel(&bs, 2, 2, 1, &empty), 2039);
+
+    PASS();
+}
+
+static enum greatest_test_res assert_perft_stats(const PerftStats *stats, const uint64_t expected[9])
+{
+    ASSERT_EQ(stats->nodes, expected[0]);
+    ASSERT_EQ(stats->captures, expected[1]);
+    ASSERT_EQ(stats->en_passants, expected[2]);
+    ASSERT_EQ(stats->castles, expected[3]);
+    ASSERT_EQ(stats->promotions, expected[4]);
+    ASSERT_EQ(stats->checks, expected[5]);
+    ASSERT_EQ(stats->discovered_checks, expected[6]);
+    ASSERT_EQ(stats->double_checks, expected[7]);
+    ASSERT_EQ(stats->checkmates, expected[8]);
+    PASS();
+}
+
+TEST test_perft_stats(void)
+{
+    // Reference values from the chess programming wiki
+    PerftStats stats[5];
+    BoardState bs = load_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    perft_stats(&bs, 5, 2, 2, stats);
+    CHECK_CALL(assert_perft_stats(&stats[0], (uint64_t[9]){20, 0, 0, 0, 0, 0, 0, 0, 0}));
+    CHECK_CALL(assert_perft_stats(&stats[3], (uint64_t[9]){197281, 1576, 0, 0, 0, 469, 0, 0, 8}));
+    CHECK_CALL(assert_perft_stats(&stats[4], (uint64_t[9]){4865609, 82719, 258, 0, 0, 27351, 6, 0, 347}));
+
+    bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    perft_stats(&bs, 4, 3, 3, stats);
+    CHECK_CALL(assert_perft_stats(&stats[2], (uint64_t[9]){97862, 17102, 45, 3162, 0, 993, 0, 0, 1}));
+    CHECK_CALL(assert_perft_stats(&stats[3], (uint64_t[9]){4085603, 757163, 1929, 128013, 15172, 25523, 42, 6, 43}));
+
+    bs = load_fen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
+    perft_stats(&bs, 5, 1, 1, stats);
+    CHECK_CALL(assert_perft_stats(&stats[4], (uint64_t[9]){674624, 52051, 1165, 0, 0, 52950, 1292, 3, 0}));
+
+    PASS();
+}
+
+TEST test_board_state(void)
+{
+    BoardState bs = load_fen("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w Kq f6 0 3");
+    ASSERT_EQ(bs.turn, C_WHITE);
+    ASSERT_EQ(bs.castle_rights, CASTLE_RIGHT_WHITE_KING_SIDE | CASTLE_RIGHT_BLACK_QUEEN_SIDE);
+    ASSERT_EQ(bs.en_passant, pos_to_square((Pos){5, 2}));
+    ASSERT_EQ(bs.halfmove_clock, 0);
+    ASSERT_EQ(bs.fullmove_number, 3);
+    ASSERT(sizeof(BoardState) <= 128);
+
+    // Capturing a rook loses the castling right on its side
+    bs = load_fen("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+    make_move(&bs, parse_algebraic_notation(&bs, "Rxa8+"));
+    ASSERT_EQ(bs.castle_rights, CASTLE_RIGHT_WHITE_KING_SIDE | CASTLE_RIGHT_BLACK_KING_SIDE);
+    ASSERT_EQ(bs.en_passant, SQUARE_NONE);
+    ASSERT_EQ(bs.halfmove_clock, 0);
+    ASSERT_EQ(bs.zobrist_hash, load_fen("R3k2r/8/8/8/8/8/8/4K2R b Kk - 0 1").zobrist_hash);
+
+    // The halfmove clock stops at 255 instead of wrapping, unmake still restores it
+    bs = load_fen("4k3/8/8/8/8/8/8/R3K3 w - - 254 1");
+    MoveUndo undo_first;
+    Move first = parse_algebraic_notation(&bs, "Ra2");
+    make_move_undo(&bs, first, &undo_first);
+    ASSERT_EQ(bs.halfmove_clock, 255);
+    MoveUndo undo_second;
+    Move second = parse_algebraic_notation(&bs, "Kd7");
+    make_move_undo(&bs, second, &undo_second);
+    ASSERT_EQ(bs.halfmove_clock, 255);
+    char fen[FEN_MAX_LENGTH];
+    board_to_fen(&bs, fen);
+    ASSERT_STR_EQ("8/3k4/8/8/8/8/R7/4K3 w - - 255 2", fen);
+    unmake_move(&bs, second, &undo_second);
+    ASSERT_EQ(bs.halfmove_clock, 255);
+    unmake_move(&bs, first, &undo_first);
+    ASSERT_EQ(bs.halfmove_clock, 254);
+
+    PASS();
+}
+
+TEST test_move_encoding(void)
+{
+    ASSERT_EQ(sizeof(Move), 2);
+
+    for (Promotion promotion = PROMOTION_NONE; promotion <= PROMOTION_KNIGHT; promotion++)
+    {
+        Move move = move_create(12, 4, promotion, CASTLE_NONE, false);
+        ASSERT_EQ(move_from(move), 12);
+        ASSERT_EQ(move_to(move), 4);
+        ASSERT_EQ(move_get_promotion(move), promotion);
+        ASSERT_EQ(move_get_castle(move), CASTLE_NONE);
+        ASSERT_FALSE(move_get_en_passant(move));
+    }
+
+    Move move = move_create(60, 62, PROMOTION_NONE, CASTLE_KINGSIDE, false);
+    ASSERT_EQ(move_get_castle(move), CASTLE_KINGSIDE);
+    ASSERT_EQ(move_get_promotion(move), PROMOTION_NONE);
+    move = move_create(27, 20, PROMOTION_NONE, CASTLE_NONE, true);
+    ASSERT(move_get_en_passant(move));
+    ASSERT_EQ(move_get_castle(move), CASTLE_NONE);
+
+    // Long notation round trip, flags are recovered from the position
+    BoardState bs = load_fen("r3k3/1P6/8/3pP3/8/8/8/4K2R w Kq d6 0 1");
+    const char *notations[] = {"b7b8q", "b7a8n", "e5d6", "e1g1", "h1h8"};
+    for (size_t i = 0; i < sizeof(notations) / sizeof(notations[0]); i++)
+    {
+        char buffer[6];
+        memcpy(buffer, notations[i], strlen(notations[i]) + 1);
+        move_to_long_notation(parse_long_notation(&bs, buffer), buffer);
+        ASSERT_STR_EQ(buffer, notations[i]);
+    }
+    char en_passant[6] = "e5d6";
+    char castle[6] = "e1g1";
+    char promotion[6] = "b7a8n";
+    ASSERT(move_get_en_passant(parse_long_notation(&bs, en_passant)));
+    ASSERT_EQ(move_get_castle(parse_long_notation(&bs, castle)), CASTLE_KINGSIDE);
+    ASSERT_EQ(move_get_promotion(parse_long_notation(&bs, promotion)), PROMOTION_KNIGHT);
+
+    PASS();
+}
+
+TEST test_bitboards(void)
+{
+    BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    make_move(&bs, parse_algebraic_notation(&bs, "O-O"));
+    make_move(&bs, parse_algebraic_notation(&bs, "Bxe2"));
+
+    for (Square sq = 0; sq < 64; sq++)
     {
-        for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+        Piece p = get_piece(&bs, square_to_pos(sq));
+        bool occupied = (get_occupied_bitboard(&bs) & square_bb(sq)) != 0;
+        ASSERT_EQ(occupied, !is_empty(p));
+
+        for (Color c = C_WHITE; c <= C_BLACK; c++)
         {
-            Piece p = create_piece(pt, c);
+            for (PieceType pt = PT_PAWN; pt <= PT_KING; pt++)
+            {
+                bool on_square = (get_pieces_bitboard(&bs, pt, c) & square_bb(sq)) != 0;
+                ASSERT_EQ(on_square, p == create_piece(pt, c));
+            }
+        }
+    }
+
+    PASS();
+}
 
-            int8_t index;
-            int8_t *len;
-            pieces_offset(&bs.pieces, pt, c, &index, &len);
-            for (int8_t i = index; i < index + *len; i++)
+// Attacks walked square by square, stopping on the first blocker
+static Bitboard slider_attacks_walk(Square sq, Bitboard occupied, bool bishop)
+{
+    static const int8_t steps[2][4][2] = {{{1, 0}, {-1, 0}, {0, 1}, {0, -1}}, {{1, 1}, {-1, 1}, {1, -1}, {-1, -1}}};
+    Bitboard attacks = BB_EMPTY;
+    for (int d = 0; d < 4; d++)
+    {
+        Pos pos = square_to_pos(sq);
+        while (true)
+        {
+            pos.x += steps[bishop][d][0];
+            pos.y += steps[bishop][d][1];
+            if (pos.x < 0 || pos.x > 7 || pos.y < 0 || pos.y > 7)
             {
-                ASSERT_EQ(get_piece(&bs, bs.pieces.list[i]), p);
+                break;
+            }
+            attacks |= square_bb(pos_to_square(pos));
+            if (occupied & square_bb(pos_to_square(pos)))
+            {
+                break;
             }
         }
     }
+    return attacks;
+}
+
+TEST test_slider_attacks(void)
+{
+    SliderAttacks detected = bitboard_slider_attacks();
+
+    for (SliderAttacks method = SLIDER_ATTACKS_MAGIC; method <= SLIDER_ATTACKS_PEXT; method++)
+    {
+        // Not supported by this CPU
+        if (!bitboard_use_slider_attacks(method))
+        {
+            continue;
+        }
+
+        BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+        ASSERT_EQ(perft(bs, 3), 97862);
+
+        // Every square against pseudo random occupancies, sparse and dense
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < 256; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            Bitboard occupied = i % 2 == 0 ? seed & (seed >> 11) : seed;
+            for (Square sq = 0; sq < 64; sq++)
+            {
+                ASSERT_EQ(bishop_attacks(sq, occupied), slider_attacks_walk(sq, occupied, true));
+                ASSERT_EQ(rook_attacks(sq, occupied), slider_attacks_walk(sq, occupied, false));
+            }
+        }
+    }
+
+    bitboard_use_slider_attacks(detected);
+
+    PASS();
+}
+
+static void collect_positions(BoardState *bs, int depth, Array(BoardState) * out_positions)
+{
+    array_push(*out_positions, *bs);
+    if (depth == 0)
+    {
+        return;
+    }
+
+    MoveList moves;
+    move_list_init(&moves);
+    generate_legal_moves(bs, bs->turn, &moves);
+    for (size_t i = 0; i < moves.len; i++)
+    {
+        MoveUndo undo;
+        make_move_undo(bs, moves.moves[i], &undo);
+        collect_positions(bs, depth - 1, out_positions);
+        unmake_move(bs, moves.moves[i], &undo);
+    }
+}
+
+TEST test_batch(void)
+{
+    // The perft positions, with castling, en passant pins, promotions and checks along the tree
+    const char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    };
+
+    Array(BoardState) positions = array_create(BoardState);
+    for (size_t i = 0; i < sizeof(fens) / sizeof(fens[0]); i++)
+    {
+        BoardState bs = load_fen(fens[i]);
+        collect_positions(&bs, 2, &positions);
+    }
+
+    uint32_t *counts = malloc(array_len(positions) * sizeof(uint32_t));
+    CpuIsa detected = cpu_isa();
+    for (CpuIsa isa = CPU_ISA_BASELINE; isa <= CPU_ISA_AVX512; isa++)
+    {
+        if (!cpu_use_isa(isa))
+        {
+            continue;
+        }
+
+        batch_count_legal_moves(positions, array_len(positions), counts);
+        for (size_t i = 0; i < array_len(positions); i++)
+        {
+            MoveList moves;
+            move_list_init(&moves);
+            generate_legal_moves(&positions[i], positions[i].turn, &moves);
+            ASSERT_EQ(counts[i], moves.len);
+        }
+    }
+    cpu_use_isa(detected);
+    free(counts);
+
+    // Checkers and pins, in the orientation of the positions
+    PositionBatch batch;
+    BatchResult result;
+    batch_clear(&batch);
+    BoardState pinned = load_fen("4k3/4r3/8/8/8/8/4B3/4K3 w - - 0 1");
+    BoardState check = load_fen("R3k3/8/8/8/8/8/8/4K3 b - - 0 1");
+    batch_push(&batch, &pinned);
+    batch_push(&batch, &check);
+    batch_analyze(&batch, &result);
+
+    ASSERT_EQ(result.pinned[0], square_bb(pos_to_square((Pos){4, 6})));
+    ASSERT_EQ(result.checkers[0], BB_EMPTY);
+    ASSERT_EQ(result.legal_moves[0], 4);
+    ASSERT_EQ(result.checkers[1], square_bb(pos_to_square((Pos){0, 0})));
+    ASSERT_EQ(result.pinned[1], BB_EMPTY);
+    // The rook sees through the king
+    ASSERT((result.attacked[1] & square_bb(pos_to_square((Pos){7, 0}))) != BB_EMPTY);
+    ASSERT_EQ(result.legal_moves[1], 3);
+
+    array_free(positions);
+
+    PASS();
+}
+
+TEST test_isa_kernels(void)
+{
+    CpuIsa detected = cpu_isa();
+    ASSERT_EQ(detected, cpu_best_isa());
+
+    BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    double expected_eval = evaluate(&bs);
+    Bitboard expected_attacks = generate_attack_bitboard(&bs, C_BLACK);
+
+    // Attack queries and SEE of every move, checked against the detected level
+    MoveList moves;
+    move_list_init(&moves);
+    generate_legal_moves(&bs, C_WHITE, &moves);
+    CheckInfo ci;
+    check_info_init(&bs, &ci);
+    bool expected_checks[MAX_MOVES];
+    int32_t expected_see[MAX_MOVES];
+    Bitboard expected_attackers[MAX_MOVES];
+    for (size_t i = 0; i < moves.len; i++)
+    {
+        expected_checks[i] = gives_check(&bs, &ci, moves.moves[i]);
+        expected_see[i] = see(&bs, moves.moves[i]);
+        expected_attackers[i] = attackers_to(&bs, move_to(moves.moves[i]), get_occupied_bitboard(&bs));
+    }
+
+    for (CpuIsa isa = CPU_ISA_BASELINE; isa <= CPU_ISA_AVX512; isa++)
+    {
+        // Not built or not supported by this CPU
+        if (!cpu_use_isa(isa))
+        {
+            continue;
+        }
+
+        ASSERT_EQ(cpu_isa(), isa);
+        ASSERT_EQ(perft(bs, 3), 97862);
+        ASSERT_EQ(evaluate(&bs), expected_eval);
+        ASSERT_EQ(generate_attack_bitboard(&bs, C_BLACK), expected_attacks);
+        for (size_t i = 0; i < moves.len; i++)
+        {
+            Move move = moves.moves[i];
+            ASSERT_EQ(gives_check(&bs, &ci, move), expected_checks[i]);
+            ASSERT_EQ(see(&bs, move), expected_see[i]);
+            ASSERT(see_ge(&bs, move, expected_see[i]) && !see_ge(&bs, move, expected_see[i] + 1));
+            ASSERT_EQ(attackers_to(&bs, move_to(move), get_occupied_bitboard(&bs)), expected_attackers[i]);
+            bool attacked = (expected_attacks & square_bb(move_to(move))) != BB_EMPTY;
+            ASSERT_EQ(is_square_attacked(&bs, move_to(move), C_BLACK), attacked);
+        }
+    }
+
+    cpu_use_isa(detected);
+
+    PASS();
+}
+
+TEST test_fen(void)
+{
+    const char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w Kq f6 0 3",
+        "8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 99 255",
+        "k7/8/8/8/8/8/QQQQQQQQ/Q6K b - - 0 1", // every pawn promoted
+    };
+
+    for (size_t i = 0; i < sizeof(fens) / sizeof(fens[0]); i++)
+    {
+        BoardState bs;
+        const char *end;
+        ASSERT_EQ(parse_fen(fens[i], &bs, &end), FEN_OK);
+        ASSERT_EQ(*end, '\0');
+
+        char buffer[FEN_MAX_LENGTH];
+        ASSERT_EQ(board_to_fen(&bs, buffer), strlen(fens[i]));
+        ASSERT_STR_EQ(fens[i], buffer);
+
+        // The keys computed at once match the ones made move by move
+        BoardState fresh = {0};
+        for (Square sq = 0; sq < 64; sq++)
+        {
+            if (!is_empty(piece_on(&bs, sq)))
+            {
+                set_piece(&fresh, square_to_pos(sq), piece_on(&bs, sq));
+            }
+        }
+        ASSERT_EQ(bs.material_key, fresh.material_key);
+        ASSERT_EQ(bs.pawn_key, fresh.pawn_key);
+    }
+
+    // EPD positions have no clocks, whatever follows the last field is left to the caller
+    BoardState bs;
+    const char *end;
+    ASSERT_EQ(parse_fen("4k3/8/8/8/8/8/8/4K3 b - - moves e8d8", &bs, &end), FEN_OK);
+    ASSERT_STR_EQ(" moves e8d8", end);
+    ASSERT_EQ(bs.turn, C_BLACK);
+    ASSERT_EQ(bs.halfmove_clock, 0);
+    ASSERT_EQ(bs.fullmove_number, 1);
+
+    struct
+    {
+        const char *fen;
+        FenError error;
+    } invalid[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1", FEN_ERROR_BOARD},
+        {"rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_ERROR_BOARD},
+        {"rnbqkbnr/pppppppp/44/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_ERROR_BOARD},
+        {"rnbqkbnr/ppppxppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_ERROR_BOARD},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1", FEN_ERROR_TURN},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkk - 0 1", FEN_ERROR_CASTLING},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN1 w KQkq - 0 1", FEN_ERROR_CASTLING},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e3 0 1", FEN_ERROR_EN_PASSANT},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e6 0 1", FEN_ERROR_EN_PASSANT},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0", FEN_ERROR_CLOCKS},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 4294967296 1", FEN_ERROR_CLOCKS},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 12x 1", FEN_ERROR_CLOCKS},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 65536", FEN_ERROR_CLOCKS},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQQBNR w kq - 0 1", FEN_ERROR_KINGS},
+        {"rnbqkbnP/pppppppp/8/8/8/8/PPPPPPP1/RNBQKBNR w KQq - 0 1", FEN_ERROR_PAWNS},
+        {"k7/8/8/8/P7/PPPPPPPP/PPPPPPPP/7K w - - 0 1", FEN_ERROR_MATERIAL},
+        {"k7/8/8/8/8/PPPPPPPP/NNNNNNNN/QQ5K w - - 0 1", FEN_ERROR_MATERIAL},
+        {"k7/8/8/8/8/8/PPPPPPP1/QQQ4K w - - 0 1", FEN_ERROR_MATERIAL},
+        {"4k3/8/8/8/8/8/8/4R1K1 w - - 0 1", FEN_ERROR_CHECK},
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        ASSERT_EQ_FMT(invalid[i].error, parse_fen(invalid[i].fen, &bs, NULL), "%d");
+    }
+
+    // A halfmove clock past 255 stops there, as make_move does
+    ASSERT_EQ(parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 256 200", &bs, NULL), FEN_OK);
+    ASSERT_EQ(bs.halfmove_clock, 255);
+    ASSERT_EQ(parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 4294967295 1", &bs, NULL), FEN_OK);
+    ASSERT_EQ(bs.halfmove_clock, 255);
+    ASSERT_EQ(parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 254 1", &bs, NULL), FEN_OK);
+    ASSERT_EQ(bs.halfmove_clock, 254);
+
+    PASS();
+}
+
+TEST test_epd(void)
+{
+    EpdEntry entry;
+    ASSERT_EQ(parse_epd("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - bm Bb5 Bc4; id \"open;ing\";"
+                        " c0 \"comment\"; hmvc 2; fmvn 3;",
+                        &entry),
+              FEN_OK);
+    ASSERT_STR_EQ("Bb5 Bc4", entry.best_moves);
+    ASSERT_STR_EQ("open;ing", entry.id);
+    ASSERT_EQ(entry.bs.halfmove_clock, 2);
+    ASSERT_EQ(entry.bs.fullmove_number, 3);
+    ASSERT_EQ(entry.perft_depth, 0);
+    ASSERT_EQ(parse_epd("4k3/8/8/8/8/8/8/4K2R w K - hmvc 300;", &entry), FEN_OK);
+    ASSERT_EQ(entry.bs.halfmove_clock, 255);
+
+    // Perft suite style, clocks and no ';' at the end
+    ASSERT_EQ(parse_epd("4k3/8/8/8/8/8/8/4K2R w K - 0 1 ;D1 15 ;D2 66 ;D3 1197", &entry), FEN_OK);
+    ASSERT_EQ(entry.perft_depth, 3);
+    ASSERT_EQ(entry.perft[1], 15);
+    ASSERT_EQ(entry.perft[2], 66);
+    ASSERT_EQ(entry.perft[3], 1197);
+    ASSERT_EQ(entry.perft_present, 0xE);
+
+    // A count of 0 (mate or stalemate) is still given, D2 is left out
+    ASSERT_EQ(parse_epd("7k/6Q1/6K1/8/8/8/8/8 b - - ;D1 0 ;D3 0", &entry), FEN_OK);
+    ASSERT_EQ(entry.perft_depth, 3);
+    ASSERT_EQ(entry.perft_present, (1 << 1) | (1 << 3));
+    ASSERT_EQ(entry.perft[1], 0);
+
+    ASSERT_EQ(parse_epd("4k3/8/8/8/8/8/8/4K2R w K - id \"unterminated;", &entry), FEN_ERROR_OPERATION);
+    ASSERT_EQ(parse_epd("4k3/8/8/8/8/8/8/4K2R w K - D2 many;", &entry), FEN_ERROR_OPERATION);
+
+    // Bulk reading keeps invalid lines and skips blank ones
+    const char *path = "chess_test.epd";
+    FILE *f = fopen(path, "w");
+    ASSERT(f != NULL);
+    for (int i = 0; i < 100; i++)
+    {
+        fprintf(f, "4k3/8/8/8/8/8/8/4K2R w K - ;D1 15 ;id \"%d\"\n", i);
+    }
+    fprintf(f, "\n   \r\nnot a fen\n4k3/8/8/8/8/8/8/4K2R w K - ;D1 15");
+    fclose(f);
+
+    Array(EpdEntry) entries;
+    ASSERT(epd_read_file(path, 4, &entries));
+    remove(path);
+
+    ASSERT_EQ(array_len(entries), 102);
+    for (size_t i = 0; i < 100; i++)
+    {
+        char id[EPD_ID_LENGTH];
+        snprintf(id, sizeof(id), "%zu", i);
+        ASSERT_EQ(entries[i].error, FEN_OK);
+        ASSERT_EQ(entries[i].line, i + 1);
+        ASSERT_STR_EQ(id, entries[i].id);
+        ASSERT_EQ(entries[i].perft[1], 15);
+    }
+    ASSERT_EQ(entries[100].error, FEN_ERROR_BOARD);
+    ASSERT_EQ(entries[100].line, 103);
+    ASSERT_EQ(entries[101].error, FEN_OK);
+    array_free(entries);
+
+    ASSERT_FALSE(epd_read_file("missing.epd", 1, &entries));
 
     PASS();
 }
 
 TEST test_zobrist_hash(void)
 {
+    // Keys are constant data, the same on every run and every machine
+    {
+        BoardState bs = load_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+        ASSERT_EQ(bs.zobrist_hash, 0x3A2E6171CDD74B3EULL);
+    }
+
     {
         BoardState bs1 = load_fen("k7/8/8/8/8/8/8/K7 w - - 0 1");
         make_move(&bs1, parse_algebraic_notation(&bs1, "Ka2"));
@@ -107,6 +652,423 @@ TEST test_zobrist_hash(void)
     PASS();
 }
 
+// Incremental keys match the keys of the same pieces placed from scratch, checked on every node up to depth
+static enum greatest_test_res check_incremental_keys(BoardState *bs, int depth)
+{
+    BoardState fresh = {0};
+    for (Square sq = 0; sq < 64; sq++)
+    {
+        if (!is_empty(piece_on(bs, sq)))
+        {
+            set_piece(&fresh, square_to_pos(sq), piece_on(bs, sq));
+        }
+    }
+
+    ASSERT_EQ(bs->pawn_key, fresh.pawn_key);
+    ASSERT_EQ(bs->material_key, fresh.material_key);
+    ASSERT_MEM_EQ(bs->non_pawn_key, fresh.non_pawn_key, sizeof(fresh.non_pawn_key));
+
+    if (depth > 1)
+    {
+        MoveList moves;
+        move_list_init(&moves);
+        generate_legal_moves(bs, bs->turn, &moves);
+        for (size_t i = 0; i < moves.len; i++)
+        {
+            MoveUndo undo;
+            make_move_undo(bs, moves.moves[i], &undo);
+            CHECK_CALL(check_incremental_keys(bs, depth - 1));
+            unmake_move(bs, moves.moves[i], &undo);
+        }
+    }
+
+    PASS();
+}
+
+TEST test_incremental_keys(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        CHECK_CALL(check_incremental_keys(&bs, 3));
+    }
+
+    // Same material anywhere on the board, pawns and pieces keyed apart
+    BoardState a = load_fen("4k3/8/8/3p4/8/2N5/8/4K3 w - - 0 1");
+    BoardState b = load_fen("4k3/2p5/8/8/8/8/5N2/4K3 w - - 0 1");
+    ASSERT_EQ(a.material_key, b.material_key);
+    ASSERT(a.pawn_key != b.pawn_key);
+    ASSERT(a.non_pawn_key[C_WHITE - 1] != b.non_pawn_key[C_WHITE - 1]);
+    ASSERT_EQ(a.non_pawn_key[C_BLACK - 1], b.non_pawn_key[C_BLACK - 1]);
+
+    PASS();
+}
+
+TEST test_unmake_move(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        BoardState original = bs;
+
+        MoveList moves;
+        move_list_init(&moves);
+        generate_legal_moves(&bs, bs.turn, &moves);
+        for (size_t i = 0; i < moves.len; i++)
+        {
+            MoveUndo undo;
+            make_move_undo(&bs, moves.moves[i], &undo);
+            unmake_move(&bs, moves.moves[i], &undo);
+
+            ASSERT_MEM_EQ(bs.pieces_bb, original.pieces_bb, sizeof(bs.pieces_bb));
+            ASSERT_MEM_EQ(bs.color_bb, original.color_bb, sizeof(bs.color_bb));
+            ASSERT_EQ(bs.zobrist_hash, original.zobrist_hash);
+            ASSERT_EQ(bs.pawn_key, original.pawn_key);
+            ASSERT_EQ(bs.material_key, original.material_key);
+            ASSERT_MEM_EQ(bs.non_pawn_key, original.non_pawn_key, sizeof(bs.non_pawn_key));
+            ASSERT_EQ(bs.turn, original.turn);
+            ASSERT_EQ(bs.castle_rights, original.castle_rights);
+            ASSERT_EQ(bs.en_passant, original.en_passant);
+            ASSERT_EQ(bs.halfmove_clock, original.halfmove_clock);
+            ASSERT_EQ(bs.fullmove_number, original.fullmove_number);
+        }
+    }
+
+    PASS();
+}
+
+// Noisy and quiet moves split the legal moves, checked on every node up to depth
+static enum greatest_test_res check_move_gen_types(BoardState *bs, int depth)
+{
+    MoveList legal, noisy, quiet;
+    move_list_init(&legal);
+    move_list_init(&noisy);
+    move_list_init(&quiet);
+    generate_legal_moves(bs, bs->turn, &legal);
+    generate_noisy_moves(bs, bs->turn, &noisy);
+    generate_quiet_moves(bs, bs->turn, &quiet);
+
+    ASSERT_EQ(noisy.len + quiet.len, legal.len);
+    for (size_t i = 0; i < noisy.len; i++)
+    {
+        ASSERT(move_is_noisy(bs, noisy.moves[i]));
+    }
+    for (size_t i = 0; i < quiet.len; i++)
+    {
+        ASSERT_FALSE(move_is_noisy(bs, quiet.moves[i]));
+    }
+
+    if (depth > 1)
+    {
+        for (size_t i = 0; i < legal.len; i++)
+        {
+            MoveUndo undo;
+            make_move_undo(bs, legal.moves[i], &undo);
+            CHECK_CALL(check_move_gen_types(bs, depth - 1));
+            unmake_move(bs, legal.moves[i], &undo);
+        }
+    }
+
+    PASS();
+}
+
+TEST test_move_gen_types(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        CHECK_CALL(check_move_gen_types(&bs, 3));
+    }
+
+    PASS();
+}
+
+TEST test_evasions(void)
+{
+    const char *fens[] = {
+        "4k3/8/8/8/1b6/8/2P1N3/R3K3 w Q - 0 1", // block or step away, castling is not an evasion
+        "4k3/8/8/8/8/5n2/8/4K2r w - - 0 1",     // double check
+        "8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",    // en passant captures the checker
+        "k3q3/8/8/8/8/8/4N3/4K2r w - - 0 1",    // the pinned knight can't block on g1
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        ASSERT(is_in_check(&bs, bs.turn));
+
+        MoveList evasions;
+        move_list_init(&evasions);
+        generate_evasions(&bs, bs.turn, &evasions);
+
+        // Every pseudo move that gets out of check must be an evasion
+        MoveList pseudo;
+        move_list_init(&pseudo);
+        generate_pseudo_moves(&bs, bs.turn, &pseudo);
+
+        size_t legal = 0;
+        for (size_t i = 0; i < pseudo.len; i++)
+        {
+            Color color = bs.turn;
+            MoveUndo undo;
+            make_move_undo(&bs, pseudo.moves[i], &undo);
+            bool is_legal = !is_in_check(&bs, color);
+            unmake_move(&bs, pseudo.moves[i], &undo);
+
+            if (is_legal && move_get_castle(pseudo.moves[i]) == CASTLE_NONE)
+            {
+                size_t j = 0;
+                while (j < evasions.len && evasions.moves[j] != pseudo.moves[i])
+                {
+                    j++;
+                }
+                ASSERT(j < evasions.len);
+                legal++;
+            }
+        }
+        ASSERT_EQ(evasions.len, legal);
+    }
+
+    PASS();
+}
+
+TEST test_move_legality(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+        "4k3/8/8/8/8/5n2/8/4K2r w - - 0 1",
+        "k3q3/8/8/8/8/8/4N3/4K2r w - - 0 1",
+    };
+
+    static bool is_legal[UINT16_MAX + 1];
+    static bool is_pseudo_legal[UINT16_MAX + 1];
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        memset(is_legal, 0, sizeof(is_legal));
+        memset(is_pseudo_legal, 0, sizeof(is_pseudo_legal));
+
+        MoveList moves;
+        move_list_init(&moves);
+        generate_legal_moves(&bs, bs.turn, &moves);
+        for (size_t i = 0; i < moves.len; i++)
+        {
+            is_legal[moves.moves[i]] = true;
+        }
+
+        move_list_init(&moves);
+        generate_pseudo_moves(&bs, bs.turn, &moves);
+        for (size_t i = 0; i < moves.len; i++)
+        {
+            is_pseudo_legal[moves.moves[i]] = true;
+        }
+
+        // Every possible encoding, generated or not
+        for (uint32_t m = 0; m <= UINT16_MAX; m++)
+        {
+            ASSERT_EQ(is_move_pseudo_legal(&bs, (Move)m), is_pseudo_legal[m]);
+            ASSERT_EQ(is_move_legal(&bs, (Move)m), is_legal[m]);
+        }
+    }
+
+    PASS();
+}
+
+TEST test_move_picker(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "4k3/8/8/8/1b6/8/2P1N3/R3K3 w Q - 0 1",
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+
+        MoveList legal;
+        move_list_init(&legal);
+        generate_legal_moves(&bs, bs.turn, &legal);
+
+        // A legal quiet tt move, a legal killer, and an illegal killer
+        Move tt_move = legal.moves[legal.len - 1];
+        Move killers[2] = {legal.moves[0], move_create(0, 63, PROMOTION_NONE, CASTLE_NONE, false)};
+
+        bool seen[MAX_MOVES] = {0};
+        size_t count = 0;
+
+        MovePicker mp;
+        move_picker_init(&mp, &bs, tt_move, killers);
+        Move move;
+        while (move_picker_next(&mp, &move))
+        {
+            if (count == 0)
+            {
+                ASSERT_EQ(move, tt_move);
+            }
+
+            size_t i = 0;
+            while (i < legal.len && legal.moves[i] != move)
+            {
+                i++;
+            }
+            ASSERT(i < legal.len);
+            ASSERT_FALSE(seen[i]);
+            seen[i] = true;
+            count++;
+        }
+        ASSERT_EQ(count, legal.len);
+
+        // Quiescence search only gets captures and promotions
+        count = 0;
+        move_picker_init_qsearch(&mp, &bs, MOVE_NONE);
+        while (move_picker_next(&mp, &move))
+        {
+            ASSERT(move_is_noisy(&bs, move));
+            count++;
+        }
+
+        size_t noisy = 0;
+        for (size_t i = 0; i < legal.len; i++)
+        {
+            noisy += move_is_noisy(&bs, legal.moves[i]);
+        }
+        ASSERT_EQ(count, noisy);
+    }
+
+    PASS();
+}
+
+// gives_check agrees with making the move, checked on every node up to depth
+static enum greatest_test_res check_gives_check(BoardState *bs, int depth)
+{
+    MoveList legal;
+    move_list_init(&legal);
+    generate_legal_moves(bs, bs->turn, &legal);
+
+    CheckInfo ci;
+    check_info_init(bs, &ci);
+
+    for (size_t i = 0; i < legal.len; i++)
+    {
+        bool check = gives_check(bs, &ci, legal.moves[i]);
+
+        MoveUndo undo;
+        make_move_undo(bs, legal.moves[i], &undo);
+        ASSERT_EQ(check, is_in_check(bs, bs->turn));
+        if (depth > 1)
+        {
+            CHECK_CALL(check_gives_check(bs, depth - 1));
+        }
+        unmake_move(bs, legal.moves[i], &undo);
+    }
+
+    PASS();
+}
+
+TEST test_gives_check(void)
+{
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "8/8/8/1k1pP2R/8/8/8/4K3 w - d6 0 1", // en passant uncovers the rook
+        "5k2/8/8/8/8/8/8/4K2R w K - 0 1",     // the castled rook checks
+        "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+        "8/4P3/8/8/8/8/8/K3k3 w - - 0 1", // the promoted piece checks through the square the pawn left
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+        CHECK_CALL(check_gives_check(&bs, 3));
+    }
+
+    PASS();
+}
+
+TEST test_see(void)
+{
+    struct
+    {
+        const char *fen;
+        char move[6];
+        int32_t value;
+    } cases[] = {
+        {"4k3/8/8/3p4/4P3/8/8/4K3 w - - 0 1", "e4d5", 100},      // free pawn
+        {"4k3/8/4p3/3p4/8/8/8/3QK3 w - - 0 1", "d1d5", -800},    // defended pawn
+        {"3rk3/3r4/8/3p4/8/8/3R4/3RK3 w - - 0 1", "d2d5", -400}, // x-ray defenders
+        {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5d6", 100},      // en passant
+        {"4k3/8/8/8/8/8/3p4/4K3 w - - 0 1", "e1d2", 100},        // king takes an undefended pawn
+        {"8/8/8/8/8/4k3/3p4/3R3K w - - 0 1", "d1d2", -400},      // king takes back
+        {"8/8/8/8/8/4k3/3p4/3RK3 w - - 0 1", "d1d2", 100},       // king can't take back a defended rook
+        {"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "d3e5", -200},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        BoardState bs = load_fen(cases[i].fen);
+        Move move = parse_long_notation(&bs, cases[i].move);
+
+        ASSERT_EQ(see(&bs, move), cases[i].value);
+        ASSERT(see_ge(&bs, move, cases[i].value));
+        ASSERT_FALSE(see_ge(&bs, move, cases[i].value + 1));
+    }
+
+    // see_ge agrees with see around every noisy move
+    const char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    };
+
+    for (size_t f = 0; f < sizeof(fens) / sizeof(fens[0]); f++)
+    {
+        BoardState bs = load_fen(fens[f]);
+
+        MoveList noisy;
+        move_list_init(&noisy);
+        generate_noisy_moves(&bs, bs.turn, &noisy);
+
+        for (size_t i = 0; i < noisy.len; i++)
+        {
+            int32_t value = see(&bs, noisy.moves[i]);
+            ASSERT(see_ge(&bs, noisy.moves[i], value - 1));
+            ASSERT(see_ge(&bs, noisy.moves[i], value));
+            ASSERT_FALSE(see_ge(&bs, noisy.moves[i], value + 1));
+            ASSERT_EQ(see_ge(&bs, noisy.moves[i], 0), value >= 0);
+        }
+    }
+
+    PASS();
+}
+
 TEST test_is_in_check(void)
 {
     BoardState bs = load_fen("kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1");
@@ -119,6 +1081,23 @@ TEST test_is_in_check(void)
     PASS();
 }
 
+TEST test_is_square_attacked(void)
+{
+    BoardState bs = load_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+    // Must agree with the attack map of every piece
+    for (Color c = C_WHITE; c <= C_BLACK; c++)
+    {
+        Bitboard attacks = generate_attack_bitboard(&bs, c);
+        for (Square sq = 0; sq < 64; sq++)
+        {
+            ASSERT_EQ(is_square_attacked(&bs, sq, c), (attacks & square_bb(sq)) != 0);
+        }
+    }
+
+    PASS();
+}
+
 TEST test_mate_in_one(void)
 {
     {
@@ -191,19 +1170,41 @@ GREATEST_MAIN_DEFS();
 
 int main(int argc, char **argv)
 {
-    zobrist_init();
+    bitboard_init();
 
     GREATEST_MAIN_BEGIN();
 
     RUN_TEST(test_perft_default);
     RUN_TEST(test_perft_kiwipete);
+    RUN_TEST(test_perft_3);
     RUN_TEST(test_perft_6);
+    RUN_TEST(test_perft_parallel);
+    RUN_TEST(test_perft_table);
+    RUN_TEST(test_perft_stats);
 
-    RUN_TEST(test_piece_list);
+    RUN_TEST(test_board_state);
+    RUN_TEST(test_move_encoding);
+    RUN_TEST(test_bitboards);
+    RUN_TEST(test_slider_attacks);
+    RUN_TEST(test_isa_kernels);
+    RUN_TEST(test_batch);
 
+    RUN_TEST(test_fen);
+    RUN_TEST(test_epd);
     RUN_TEST(test_zobrist_hash);
 
+    RUN_TEST(test_incremental_keys);
+    RUN_TEST(test_unmake_move);
+
+    RUN_TEST(test_move_gen_types);
+    RUN_TEST(test_evasions);
+    RUN_TEST(test_gives_check);
+    RUN_TEST(test_see);
+    RUN_TEST(test_move_legality);
+    RUN_TEST(test_move_picker);
+
     RUN_TEST(test_is_in_check);
+    RUN_TEST(test_is_square_attacked);
 
     RUN_TEST(test_mate_in_one);
     RUN_TEST(test_mate_in_two);